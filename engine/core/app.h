@@ -7,7 +7,9 @@
 	(C) 2015-2018 Individual contributors, see AUTHORS file
 */
 //------------------------------------------------------------------------------
+#ifndef HEADLESS
 #include <GL/glew.h>
+#endif
 namespace Core
 {
 class App
@@ -0,0 +1,110 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+    @file ringbuffer.h
+
+    @copyright
+    (C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <vector>
+#include <atomic>
+
+namespace Util
+{
+    //------------------------------------------------------------------------------
+    /**
+        Lock-free single producer, single consumer ring buffer.
+        Slots are filled and read in place, so elements that own storage
+        (e.g. a std::vector) keep their capacity between laps.
+    */
+    template<typename T>
+    class SpscRing
+    {
+    public:
+        /// constructor, capacity is rounded up to a power of two
+        explicit SpscRing(size_t capacity);
+
+        /// producer: get the next free slot, nullptr if the ring is full
+        T* Reserve();
+        /// producer: publish the slot returned by Reserve
+        void Commit();
+        /// consumer: get the oldest published slot, nullptr if the ring is empty
+        T* Peek();
+        /// consumer: hand the slot returned by Peek back to the producer
+        void Pop();
+
+    private:
+        std::vector<T> slots;
+        size_t mask;
+        /// written by the producer only
+        alignas(64) std::atomic<size_t> head;
+        /// written by the consumer only
+        alignas(64) std::atomic<size_t> tail;
+    };
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    template<typename T>
+    SpscRing<T>::SpscRing(size_t capacity) :
+        head(0),
+        tail(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+
+        this->slots.resize(size);
+        this->mask = size - 1;
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    template<typename T>
+    T*
+        SpscRing<T>::Reserve()
+    {
+        size_t const h = this->head.load(std::memory_order_relaxed);
+        if (h - this->tail.load(std::memory_order_acquire) == this->slots.size())
+            return nullptr;
+
+        return &this->slots[h & this->mask];
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    template<typename T>
+    void
+        SpscRing<T>::Commit()
+    {
+        this->head.store(this->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    template<typename T>
+    T*
+        SpscRing<T>::Peek()
+    {
+        size_t const t = this->tail.load(std::memory_order_relaxed);
+        if (t == this->head.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &this->slots[t & this->mask];
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    template<typename T>
+    void
+        SpscRing<T>::Pop()
+    {
+        this->tail.store(this->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+}
@@ -0,0 +1,78 @@
+#include "config.h"
+#include "clocksync.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Game
+{
+	ClockSync::ClockSync()
+	{
+		Clear();
+	}
+
+	void ClockSync::AddSample(uint64 sendTime, uint64 serverTime, uint64 receiveTime)
+	{
+		if (receiveTime < sendTime)
+			return;
+
+		// the server is assumed to have answered halfway through the round trip
+		Sample& sample = samples[nextSample];
+		sample.roundTripTime = (uint32)(receiveTime - sendTime);
+		sample.offset = (int64)(sendTime - serverTime) + (int64)(sample.roundTripTime / 2);
+		nextSample = (nextSample + 1) % windowSize;
+		sampleCount = std::min(sampleCount + 1, windowSize);
+
+		// the quarter of the window with the shortest round trips waited the least on the way
+		Sample sorted[windowSize];
+		std::copy(samples, samples + sampleCount, sorted);
+		std::sort(sorted, sorted + sampleCount, [](const Sample& a, const Sample& b)
+		{
+			return a.roundTripTime < b.roundTripTime;
+		});
+
+		uint32 used = std::max(sampleCount / 4, 1u);
+		double sum = 0.0;
+		for (uint32 i = 0; i < used; i++)
+			sum += (double)sorted[i].offset;
+		estimate = sum / (double)used;
+
+		// the first few samples may all have waited somewhere, until there are enough to choose from the offset is not slewed
+		if (sampleCount <= windowSize / 4 || std::abs(estimate - offset) > (double)stepThreshold)
+			offset = estimate;
+		synced = true;
+	}
+
+	int64 ClockSync::Offset(uint64 localTime)
+	{
+		if (lastTime != 0 && localTime > lastTime)
+		{
+			double step = (double)(localTime - lastTime) * slewRate;
+			offset += std::clamp(estimate - offset, -step, step);
+		}
+		lastTime = localTime;
+		return (int64)std::llround(offset);
+	}
+
+	bool ClockSync::IsSynced() const
+	{
+		return synced;
+	}
+
+	uint32 ClockSync::RoundTripTime() const
+	{
+		uint32 best = UINT32_MAX;
+		for (uint32 i = 0; i < sampleCount; i++)
+			best = std::min(best, samples[i].roundTripTime);
+		return sampleCount > 0 ? best : 0;
+	}
+
+	void ClockSync::Clear()
+	{
+		sampleCount = 0;
+		nextSample = 0;
+		estimate = 0.0;
+		offset = 0.0;
+		lastTime = 0;
+		synced = false;
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+namespace Game
+{
+	// Estimates how far the local clock is ahead of the server's from ping/pong timestamps. Each sample's offset is
+	// off by at most half its round trip, so the estimate averages the samples of the window with the shortest round
+	// trips and ignores those that were queued somewhere on the way. The offset handed out follows the estimate slowly,
+	// so times converted with it do not jump, except over the first few samples or on a step too large to slew away.
+	class ClockSync
+	{
+	public:
+		static constexpr uint32 windowSize = 16;
+		static constexpr int64 stepThreshold = 250;		// ms off at which the offset jumps to the estimate
+		static constexpr double slewRate = 0.005;		// ms the offset moves per ms of local time
+
+		ClockSync();
+
+		// sendTime and receiveTime are local ms of the ping and its pong, serverTime the server's ms in between
+		void AddSample(uint64 sendTime, uint64 serverTime, uint64 receiveTime);
+		// local minus server time, moved towards the estimate by how much time passed since the last call
+		int64 Offset(uint64 localTime);
+		bool IsSynced() const;
+		uint32 RoundTripTime() const;
+		void Clear();
+
+	private:
+		struct Sample
+		{
+			int64 offset;
+			uint32 roundTripTime;
+		};
+
+		Sample samples[windowSize];
+		uint32 sampleCount;
+		uint32 nextSample;
+		double estimate;
+		double offset;
+		uint64 lastTime;
+		bool synced;
+	};
+}
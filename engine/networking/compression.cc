@@ -0,0 +1,398 @@
+#include "config.h"
+#include "compression.h"
+#include "netrecorder.h"
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <string>
+
+namespace Game
+{
+#pragma region dictionary
+	bool NetDictionary::Load(const char* path)
+	{
+		FILE* file = fopen(path, "rb");
+		if (file == nullptr)
+		{
+			printf("\n[ERROR] failed to open compression dictionary %s.\n", path);
+			return false;
+		}
+
+		data.resize(maxSize);
+		data.resize(fread(data.data(), 1, maxSize, file));
+		fclose(file);
+		return true;
+	}
+
+	bool NetDictionary::Save(const char* path) const
+	{
+		FILE* file = fopen(path, "wb");
+		if (file == nullptr)
+		{
+			printf("\n[ERROR] failed to open %s for writing.\n", path);
+			return false;
+		}
+
+		fwrite(data.data(), 1, data.size(), file);
+		fclose(file);
+		return true;
+	}
+
+	static uint64 Read64(const enet_uint8* data)
+	{
+		uint64 value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	bool NetDictionary::Train(const char* logPath, size_t size)
+	{
+		static const size_t segmentSize = 32;
+		static const size_t stringSize = 8;
+		static const size_t maxSamples = 64 * 1024 * 1024;
+
+		NetPlayback log;
+		if (!log.Open(logPath))
+			return false;
+
+		// the messages the recorded host sent, they are what a server compresses
+		std::vector<enet_uint8> samples;
+		NetRecord record;
+		std::vector<enet_uint8> payload;
+		while (samples.size() < maxSamples && log.Next(record, payload))
+		{
+			if (record.type == NetRecord::Type::Send)
+				samples.insert(samples.end(), payload.begin(), payload.end());
+		}
+
+		size = std::min(size, maxSize);
+		if (samples.size() < segmentSize || size < segmentSize)
+		{
+			printf("\n[ERROR] %s has too little sent traffic to train a dictionary on.\n", logPath);
+			return false;
+		}
+
+		std::unordered_map<uint64, uint32> counts;
+		for (size_t i = 0; i + stringSize <= samples.size(); i++)
+			counts[Read64(&samples[i])]++;
+
+		// every epoch of the samples contributes its best segment, the strings of a chosen segment no longer
+		// count so the next ones add content the dictionary does not have yet
+		std::vector<std::pair<uint64, size_t>> chosen;
+		size_t epoch = std::max(segmentSize, samples.size() / (size / segmentSize));
+		for (size_t begin = 0; begin + segmentSize <= samples.size() && chosen.size() < size / segmentSize; begin += epoch)
+		{
+			size_t last = std::min(begin + epoch, samples.size()) - segmentSize;
+			uint64 score = 0;
+			for (size_t i = 0; i + stringSize <= segmentSize; i++)
+				score += counts[Read64(&samples[begin + i])];
+
+			uint64 bestScore = score;
+			size_t best = begin;
+			for (size_t pos = begin + 1; pos <= last; pos++)
+			{
+				score -= counts[Read64(&samples[pos - 1])];
+				score += counts[Read64(&samples[pos + segmentSize - stringSize])];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = pos;
+				}
+			}
+
+			if (bestScore == 0)
+				continue;
+
+			chosen.push_back({ bestScore, best });
+			for (size_t i = 0; i + stringSize <= segmentSize; i++)
+				counts[Read64(&samples[best + i])] = 0;
+		}
+
+		// the most useful segments go last, where the packets reach them with the shortest offsets
+		std::sort(chosen.begin(), chosen.end());
+		data.clear();
+		for (auto& [score, pos] : chosen)
+			data.insert(data.end(), samples.begin() + pos, samples.begin() + pos + segmentSize);
+
+		return true;
+	}
+#pragma endregion dictionary
+
+#pragma region compressor
+	static bool WriteLength(enet_uint8*& out, const enet_uint8* outEnd, size_t length)
+	{
+		// the part of a length that does not fit into its token nibble, in steps of 255
+		while (length >= 255)
+		{
+			if (out == outEnd)
+				return false;
+			*out++ = 255;
+			length -= 255;
+		}
+
+		if (out == outEnd)
+			return false;
+		*out++ = (enet_uint8)length;
+		return true;
+	}
+
+	static bool ReadLength(const enet_uint8*& in, const enet_uint8* inEnd, size_t& length)
+	{
+		enet_uint8 byte;
+		do
+		{
+			if (in == inEnd)
+				return false;
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	// token, literals, and unless it is the last sequence of the packet the match offset and length
+	static bool WriteSequence(enet_uint8*& out, const enet_uint8* outEnd, const enet_uint8* literals, size_t literalCount, size_t offset, size_t matchLength)
+	{
+		if (out == outEnd)
+			return false;
+
+		size_t matchCode = matchLength > 0 ? matchLength - 4 : 0;
+		enet_uint8* token = out++;
+		*token = (enet_uint8)((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15));
+		if (literalCount >= 15 && !WriteLength(out, outEnd, literalCount - 15))
+			return false;
+
+		if ((size_t)(outEnd - out) < literalCount)
+			return false;
+		memcpy(out, literals, literalCount);
+		out += literalCount;
+
+		if (matchLength == 0)
+			return true;
+
+		if (outEnd - out < 2)
+			return false;
+		*out++ = (enet_uint8)(offset & 0xFF);
+		*out++ = (enet_uint8)(offset >> 8);
+		return matchCode < 15 || WriteLength(out, outEnd, matchCode - 15);
+	}
+
+	DictionaryCompressor::DictionaryCompressor(const NetDictionary& dictionary) :
+		window(dictionary.data.begin(), dictionary.data.begin() + std::min(dictionary.data.size(), NetDictionary::maxSize)),
+		dictionarySize(window.size()),
+		dictionaryTable((size_t)1 << hashBits, 0)
+	{
+		for (size_t i = 0; i + 4 <= dictionarySize; i++)
+			dictionaryTable[Hash(&window[i])] = (uint32)i + 1;
+	}
+
+	uint32 DictionaryCompressor::Hash(const enet_uint8* data)
+	{
+		uint32 value;
+		memcpy(&value, data, sizeof(value));
+		return (value * 2654435761u) >> (32 - hashBits);
+	}
+
+	size_t DictionaryCompressor::Compress(const ENetBuffer* inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8* outData, size_t outLimit)
+	{
+		// gather the packet behind the dictionary so matches can reach into either
+		size_t end = dictionarySize + inLimit;
+		if (window.size() < end)
+			window.resize(end);
+
+		size_t gathered = dictionarySize;
+		for (size_t i = 0; i < inBufferCount && gathered < end; i++)
+		{
+			size_t size = std::min((size_t)inBuffers[i].dataLength, end - gathered);
+			memcpy(&window[gathered], inBuffers[i].data, size);
+			gathered += size;
+		}
+		end = gathered;
+		table = dictionaryTable;
+
+		const enet_uint8* base = window.data();
+		enet_uint8* out = outData;
+		const enet_uint8* outEnd = outData + outLimit;
+		size_t literal = dictionarySize;
+		size_t pos = dictionarySize;
+		while (pos + 4 <= end)
+		{
+			uint32 hash = Hash(base + pos);
+			size_t candidate = table[hash];
+			table[hash] = (uint32)pos + 1;
+			if (candidate == 0 || pos - (candidate - 1) > 0xFFFF || memcmp(base + candidate - 1, base + pos, 4) != 0)
+			{
+				pos++;
+				continue;
+			}
+
+			size_t match = candidate - 1;
+			size_t length = 4;
+			while (pos + length < end && base[match + length] == base[pos + length])
+				length++;
+
+			if (!WriteSequence(out, outEnd, base + literal, pos - literal, pos - match, length))
+				return 0;
+			pos += length;
+			literal = pos;
+		}
+
+		if (!WriteSequence(out, outEnd, base + literal, end - literal, 0, 0))
+			return 0;
+		return out - outData;
+	}
+
+	size_t DictionaryCompressor::Decompress(const enet_uint8* inData, size_t inLimit, enet_uint8* outData, size_t outLimit)
+	{
+		// decode behind the dictionary, offsets address both the same way the compressor saw them
+		size_t limit = dictionarySize + outLimit;
+		if (window.size() < limit)
+			window.resize(limit);
+
+		enet_uint8* base = window.data();
+		size_t pos = dictionarySize;
+		const enet_uint8* in = inData;
+		const enet_uint8* inEnd = inData + inLimit;
+		while (in < inEnd)
+		{
+			enet_uint8 token = *in++;
+			size_t literalCount = token >> 4;
+			if (literalCount == 15 && !ReadLength(in, inEnd, literalCount))
+				return 0;
+			if ((size_t)(inEnd - in) < literalCount || literalCount > limit - pos)
+				return 0;
+			memcpy(base + pos, in, literalCount);
+			in += literalCount;
+			pos += literalCount;
+
+			if (in == inEnd)
+				break;
+
+			if (inEnd - in < 2)
+				return 0;
+			size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+			in += 2;
+
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !ReadLength(in, inEnd, matchLength))
+				return 0;
+			matchLength += 4;
+			if (offset == 0 || offset > pos || matchLength > limit - pos)
+				return 0;
+
+			// byte by byte, a match may overlap the bytes it produces
+			for (size_t i = 0; i < matchLength; i++)
+				base[pos + i] = base[pos - offset + i];
+			pos += matchLength;
+		}
+
+		memcpy(outData, base + dictionarySize, pos - dictionarySize);
+		return pos - dictionarySize;
+	}
+
+	ENetCompressor DictionaryCompressor::Create(const NetDictionary& dictionary)
+	{
+		ENetCompressor compressor;
+		compressor.context = new DictionaryCompressor(dictionary);
+		compressor.compress = [](void* context, const ENetBuffer* inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8* outData, size_t outLimit)
+		{
+			return ((DictionaryCompressor*)context)->Compress(inBuffers, inBufferCount, inLimit, outData, outLimit);
+		};
+		compressor.decompress = [](void* context, const enet_uint8* inData, size_t inLimit, enet_uint8* outData, size_t outLimit)
+		{
+			return ((DictionaryCompressor*)context)->Decompress(inData, inLimit, outData, outLimit);
+		};
+		compressor.destroy = [](void* context)
+		{
+			delete (DictionaryCompressor*)context;
+		};
+		return compressor;
+	}
+#pragma endregion compressor
+
+#pragma region benchmark
+	void BenchmarkCompression(const char* logPath, const NetDictionary* dictionary, const char* const* names, size_t count,
+		std::function<size_t(const enet_uint8*, size_t)> classify)
+	{
+		struct Row
+		{
+			uint64 messages = 0;
+			uint64 bytes = 0;
+			uint64 rangeBytes = 0;
+			uint64 dictionaryBytes = 0;
+			double rangeSeconds = 0.0;
+			double dictionarySeconds = 0.0;
+		};
+
+		NetPlayback log;
+		if (!log.Open(logPath))
+			return;
+
+		void* rangeCoder = enet_range_coder_create();
+		DictionaryCompressor* compressor = dictionary != nullptr ? new DictionaryCompressor(*dictionary) : nullptr;
+		std::vector<Row> rows(count + 1);
+		std::vector<enet_uint8> compressed;
+		std::vector<enet_uint8> decompressed;
+		size_t mismatches = 0;
+
+		NetRecord record;
+		std::vector<enet_uint8> payload;
+		while (log.Next(record, payload))
+		{
+			if (record.type != NetRecord::Type::Send || payload.empty())
+				continue;
+
+			size_t type = classify(payload.data(), payload.size());
+			Row& row = rows[type < count ? type : count];
+			row.messages++;
+			row.bytes += payload.size();
+
+			// like ENet, anything that does not shrink goes out as it is
+			ENetBuffer buffer;
+			buffer.data = payload.data();
+			buffer.dataLength = payload.size();
+			compressed.resize(payload.size());
+			decompressed.resize(payload.size());
+
+			auto start = std::chrono::steady_clock::now();
+			size_t size = enet_range_coder_compress(rangeCoder, &buffer, 1, payload.size(), compressed.data(), compressed.size());
+			row.rangeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			row.rangeBytes += size > 0 ? size : payload.size();
+
+			if (compressor == nullptr)
+				continue;
+
+			start = std::chrono::steady_clock::now();
+			size = compressor->Compress(&buffer, 1, payload.size(), compressed.data(), compressed.size());
+			row.dictionarySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			row.dictionaryBytes += size > 0 ? size : payload.size();
+
+			if (size > 0 && (compressor->Decompress(compressed.data(), size, decompressed.data(), decompressed.size()) != payload.size() ||
+				memcmp(decompressed.data(), payload.data(), payload.size()) != 0))
+				mismatches++;
+		}
+
+		bool hasDictionary = compressor != nullptr;
+		enet_range_coder_destroy(rangeCoder);
+		delete compressor;
+
+		printf("\n%-24s %10s %12s %12s %12s %12s %12s\n", "message", "count", "bytes", "range ratio", "range ns", "dict ratio", "dict ns");
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			const Row& row = rows[i];
+			if (row.messages == 0)
+				continue;
+
+			std::string name = i < count && names[i] != nullptr ? names[i] : "unknown";
+			printf("%-24s %10llu %12llu %12.3f %12.0f %12.3f %12.0f\n", name.c_str(),
+				(unsigned long long)row.messages, (unsigned long long)row.bytes,
+				(double)row.rangeBytes / (double)row.bytes, row.rangeSeconds * 1e9 / (double)row.messages,
+				hasDictionary ? (double)row.dictionaryBytes / (double)row.bytes : 1.0, row.dictionarySeconds * 1e9 / (double)row.messages);
+		}
+
+		if (mismatches > 0)
+			printf("\n[ERROR] %zu messages did not survive the dictionary round trip.\n", mismatches);
+	}
+#pragma endregion benchmark
+}
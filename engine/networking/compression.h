@@ -0,0 +1,59 @@
+#pragma once
+#include "enet/enet.h"
+#include <vector>
+#include <functional>
+
+namespace Game
+{
+	// Packet compression of a Host, server and clients have to use the same one.
+	enum class Compression
+	{
+		None,
+		RangeCoder,		// ENet's built in adaptive range coder
+		Dictionary		// DictionaryCompressor with a trained NetDictionary
+	};
+
+	// Preset content for DictionaryCompressor, byte strings that are common in the game's traffic.
+	class NetDictionary
+	{
+	public:
+		static constexpr size_t maxSize = 32 * 1024;
+
+		std::vector<enet_uint8> data;
+
+		bool Load(const char* path);
+		bool Save(const char* path) const;
+		// Picks the segments of the messages sent in a traffic log whose 8 byte strings are the most frequent.
+		bool Train(const char* logPath, size_t size);
+	};
+
+	// LZ77 compression for ENet packets whose matches may also reach back into a static dictionary, so a single
+	// small message still finds the vtables and headers it shares with others. The token format is the one of LZ4 blocks.
+	class DictionaryCompressor
+	{
+	private:
+		static constexpr uint32 hashBits = 12;
+
+		std::vector<enet_uint8> window;		// the dictionary followed by the packet being worked on
+		size_t dictionarySize;
+		std::vector<uint32> dictionaryTable;	// last dictionary position + 1 of every 4 byte hash
+		std::vector<uint32> table;
+
+		static uint32 Hash(const enet_uint8* data);
+
+	public:
+		DictionaryCompressor(const NetDictionary& dictionary);
+
+		// both return 0 if the result does not fit into outLimit or the input is malformed
+		size_t Compress(const ENetBuffer* inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8* outData, size_t outLimit);
+		size_t Decompress(const enet_uint8* inData, size_t inLimit, enet_uint8* outData, size_t outLimit);
+
+		// Callbacks for enet_host_compress, the host then owns a compressor made from a copy of the dictionary.
+		static ENetCompressor Create(const NetDictionary& dictionary);
+	};
+
+	// Compresses every message sent in a traffic log on its own with each codec and prints size ratio and time
+	// per message for every message type. names and classify are the ones given to NetStats::SetMessageTypes.
+	void BenchmarkCompression(const char* logPath, const NetDictionary* dictionary, const char* const* names, size_t count,
+		std::function<size_t(const enet_uint8*, size_t)> classify);
+}
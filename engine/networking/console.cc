@@ -1,6 +1,8 @@
 #include "config.h"
 #include "console.h"
+#ifndef HEADLESS
 #include "imgui.h"
+#endif
 
 namespace Game
 {
@@ -31,6 +33,10 @@ void Console::SetCommand(const std::string& name, std::function<void(const std::
 
 void Console::AddOutput(const std::string& output)
 {
+#ifdef HEADLESS
+	// there is no window to draw the output in
+	printf("%s\n", output.c_str());
+#endif
 	for (size_t i = 1; i < outputLineCount; i++)
 	{
 		for (size_t j = 0; j+1 < outputLineSize; j++)
@@ -49,8 +55,14 @@ void Console::AddOutput(const std::string& output)
 	}
 }
 
+void Console::SetPanel(std::function<void()> function)
+{
+	panel = function;
+}
+
 void Console::Draw()
 {
+#ifndef HEADLESS
 	ImGui::Begin(windowLabel);
 
 	ImGui::Text(outputBuff);
@@ -64,7 +76,11 @@ void Console::Draw()
 		ReadCommand();
 	}
 
+	if (panel)
+		panel();
+
 	ImGui::End();
+#endif
 }
 
 void Console::ClearInputBuff()
@@ -87,15 +103,14 @@ void Console::ClearOutputBuff()
 	outputBuff[outputLineCount * outputLineSize] = '\0';
 }
 
-void Console::ReadCommand()
+void Console::Execute(const std::string& line)
 {
 	bool hasName = false;
 	std::string commandName;
 	std::string commandArg;
 
-	for (size_t i = 0; i < inputBuffSize && inputBuff[i] != '\0'; i++)
+	for (char c : line)
 	{
-		char c = inputBuff[i];
 		if (!hasName && c == ' ')
 		{
 			hasName = true;
@@ -114,7 +129,11 @@ void Console::ReadCommand()
 		printf("\n[WARNING] Invalid command '%s'.\n", commandName.c_str());
 	else
 		commands[commandName](commandArg);
+}
 
+void Console::ReadCommand()
+{
+	Execute(std::string(inputBuff));
 	ClearInputBuff();
 }
 }
\ No newline at end of file
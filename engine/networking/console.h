@@ -18,12 +18,17 @@ private:
 	size_t outputLineSize;
 	size_t outputLineCount;
 
+	std::function<void()> panel;
+
 public:
 	Console(const char* _windowLabel, size_t _inputBufferSize, size_t _outputLineSize, size_t _outputLineCount);
 	~Console();
 
 	void SetCommand(const std::string& name, std::function<void(const std::string&)> function);
 	void AddOutput(const std::string& output);
+	void Execute(const std::string& line);
+	// extra widgets drawn below the input, inside the console window
+	void SetPanel(std::function<void()> function);
 	void Draw();
 
 private:
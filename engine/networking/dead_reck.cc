@@ -1,21 +1,33 @@
 #include "config.h"
 #include "dead_reck.h"
+#include <algorithm>
+#include <cmath>
 
 namespace Game
 {
 
 DeadReck::DeadReck(float _serverDeltaTime)
 {
+	mode = Mode::Buffer;
 	serverDeltaTime = _serverDeltaTime;
 	timeSinceLastUpdate = 0.f;
 	timeStamp = 0;
 	clientStart = { glm::vec3(0.f), glm::vec3(0.f), glm::vec3(0.f), glm::identity<glm::quat>() };
 	serverStart = {glm::vec3(0.f), glm::vec3(0.f), glm::vec3(0.f), glm::identity<glm::quat>()};
+
+	sampleCount = 0;
+	lastArrival = 0;
+	interval = 50.f;
+	jitter = 0.f;
+	delay = 100.f;
+	renderTime = 0.0;
+	shown = serverStart;
+	correction = glm::vec3(0.f);
 }
 
 DeadReck::~DeadReck() {} //empty
 
-void DeadReck::SetServerData(const Body& newServerData, bool hardReset, uint64 _timeStamp)
+void DeadReck::SetServerData(const Body& newServerData, bool hardReset, uint64 _timeStamp, uint64 serverTime, uint64 arrivalTime)
 {
 	if (_timeStamp < timeStamp)
 		return;
@@ -26,18 +38,129 @@ void DeadReck::SetServerData(const Body& newServerData, bool hardReset, uint64 _
 	{
 		clientStart = newServerData;
 	}
-	else
+	else if (mode == Mode::Blend)
 	{
 		// set client start body to current interpolated body
-		clientStart = Interpolate(0.f);
+		clientStart = Blend(0.f);
 	}
 
 	// reset the server body
 	timeSinceLastUpdate = 0.f;
 	serverStart = newServerData;
+
+	if (hardReset)
+	{
+		sampleCount = 0;
+		renderTime = 0.0;
+		correction = glm::vec3(0.f);
+	}
+	else if (sampleCount > 0)
+	{
+		// how much later or earlier than the server sent it the state arrived, compared to the one before
+		const Sample& newest = samples[sampleCount - 1];
+		if (serverTime < newest.time)
+			return;
+		if (serverTime > newest.time)
+		{
+			float serverGap = (float)(serverTime - newest.time);
+			float arrivalGap = (float)(int64)(arrivalTime - lastArrival);
+			jitter += (std::abs(arrivalGap - serverGap) - jitter) / 16.f;
+			interval += (std::min(serverGap, maxDelay) - interval) / 16.f;
+		}
+	}
+	lastArrival = arrivalTime;
+
+	if (sampleCount > 0 && samples[sampleCount - 1].time == serverTime)
+	{
+		samples[sampleCount - 1].body = newServerData;
+	}
+	else
+	{
+		if (sampleCount == bufferSize)
+		{
+			std::move(samples + 1, samples + bufferSize, samples);
+			sampleCount--;
+		}
+		samples[sampleCount++] = { serverTime, newServerData };
+	}
+
+	// a state for a time that was extrapolated moves the body, the jump is faded out instead of shown
+	if (renderTime > 0.0)
+		correction = shown.position - Evaluate(SegmentAt(renderTime)).position;
+}
+
+DeadReck::Body DeadReck::Interpolate(float deltaTime, uint64 serverNow)
+{
+	if (mode == Mode::Blend)
+		return Blend(deltaTime);
+
+	if (sampleCount == 0)
+		return shown;
+
+	Body body = Evaluate(Advance(deltaTime, serverNow));
+	Show(body);
+	return body;
+}
+
+DeadReck::Segment DeadReck::Advance(float deltaTime, uint64 serverNow)
+{
+	if (sampleCount == 0)
+		return { shown, shown, 0.f, 0.f, glm::vec3(0.f) };
+
+	// the delay follows its target at a tenth of real time, so playback only ever runs a little slower or faster
+	float target = std::clamp(interval + jitter * 3.f, minDelay, maxDelay);
+	float step = deltaTime * 100.f;
+	delay += std::clamp(target - delay, -step, step);
+	renderTime = std::max(renderTime, (double)serverNow - (double)delay);
+
+	Segment segment = SegmentAt(renderTime);
+	correction *= std::exp(-deltaTime * 10.f);
+	segment.correction = correction;
+
+	// states before the segment being shown are not needed anymore
+	uint32 used = 0;
+	while (used + 1 < sampleCount && (double)samples[used + 1].time <= renderTime)
+		used++;
+	if (used > 0)
+	{
+		std::move(samples + used, samples + sampleCount, samples);
+		sampleCount -= used;
+	}
+
+	return segment;
 }
 
-DeadReck::Body DeadReck::Interpolate(float deltaTime) //Currently used for client update in spaceship
+DeadReck::Body DeadReck::Evaluate(const Segment& segment)
+{
+	// hermite curve between the two states, it matches their velocities as well. the orientation takes the
+	// shorter way round, the quantized states may come with either sign
+	const Body& a = segment.a;
+	const Body& b = segment.b;
+	float t = segment.t;
+	float t2 = t * t;
+	float t3 = t2 * t;
+	float tangent = segment.span * velocityScale;
+	glm::vec3 position = a.position * (2.f * t3 - 3.f * t2 + 1.f) + a.velocity * (tangent * (t3 - 2.f * t2 + t)) +
+		b.position * (-2.f * t3 + 3.f * t2) + b.velocity * (tangent * (t3 - t2));
+	return {
+		position + segment.correction,
+		glm::mix(a.velocity, b.velocity, t),
+		b.acceleration,
+		glm::slerp(a.orientation, b.orientation, t)
+	};
+}
+
+void DeadReck::Show(const Body& body)
+{
+	shown = body;
+}
+
+float DeadReck::Delay() const
+{
+	return delay;
+}
+
+DeadReck::Body DeadReck::Blend(float deltaTime)
 {
 	timeSinceLastUpdate += deltaTime;
 	timeSinceLastUpdate = timeSinceLastUpdate > serverDeltaTime ? serverDeltaTime : timeSinceLastUpdate;
@@ -60,4 +183,32 @@ DeadReck::Body DeadReck::Interpolate(float deltaTime) //Currently used for clien
 		dirBlend
 	};
 }
-}
\ No newline at end of file
+
+DeadReck::Segment DeadReck::SegmentAt(double time) const
+{
+	if (time <= (double)samples[0].time)
+		return { samples[0].body, samples[0].body, 0.f, 0.f, glm::vec3(0.f) };
+
+	for (uint32 i = 0; i + 1 < sampleCount; i++)
+	{
+		const Sample& a = samples[i];
+		const Sample& b = samples[i + 1];
+		if (time >= (double)b.time)
+			continue;
+
+		float t = (float)((time - (double)a.time) / (double)(b.time - a.time));
+		return { a.body, b.body, t, (float)(b.time - a.time) * 0.001f, glm::vec3(0.f) };
+	}
+
+	// the buffer ran dry, carry on from the newest state for a while
+	const Body& newest = samples[sampleCount - 1].body;
+	float ahead = (float)std::min(time - (double)samples[sampleCount - 1].time, (double)maxExtrapolation) * 0.001f;
+	Body extrapolated = {
+		newest.position + (newest.velocity * ahead + newest.acceleration * (0.5f * ahead * ahead)) * velocityScale,
+		newest.velocity + newest.acceleration * ahead,
+		newest.acceleration,
+		newest.orientation
+	};
+	return { extrapolated, extrapolated, 0.f, 0.f, glm::vec3(0.f) };
+}
+}
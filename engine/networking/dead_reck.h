@@ -16,13 +16,67 @@ struct DeadReck
 		glm::quat orientation;
 	};
 
+	enum class Mode
+	{
+		Blend,		// blend from the shown body to the newest state over serverDeltaTime
+		Buffer		// interpolate between buffered states at a delay that follows the arrival jitter
+	};
+
+	// buffered states, at most maxExtrapolation ms are extrapolated past the newest one
+	static constexpr uint32 bufferSize = 16;
+	static constexpr float minDelay = 10.f;
+	static constexpr float maxDelay = 500.f;
+	static constexpr float maxExtrapolation = 250.f;
+	// units a body moves per second for each unit of velocity, SpaceShip::Simulate moves ships by it as well
+	static constexpr float velocityScale = 10.f;
+
+	Mode mode;
 	float serverDeltaTime;
 	float timeSinceLastUpdate;
 	uint64 timeStamp;
 	Body clientStart;
 	Body serverStart;
 
-	void SetServerData(const Body& newServerData, bool hardReset, uint64 _timeStamp);
-	Body Interpolate(float deltaTime);
+	// the two states around the render time, a and b are the same body when there is nothing to interpolate
+	struct Segment
+	{
+		Body a;
+		Body b;
+		float t;		// 0 at a, 1 at b
+		float span;		// seconds from a to b
+		glm::vec3 correction;
+	};
+
+	// arrivalTime is the local ms the state arrived on, serverTime the server ms it was sent on
+	void SetServerData(const Body& newServerData, bool hardReset, uint64 _timeStamp, uint64 serverTime, uint64 arrivalTime);
+	// serverNow is the server's time as estimated by the client
+	Body Interpolate(float deltaTime, uint64 serverNow);
+	float Delay() const;
+
+	// Interpolate of the Buffer mode in three steps, so InterpolationBatch can evaluate the segments of all ships at once.
+	// Evaluate is the reference the batch is held to.
+	Segment Advance(float deltaTime, uint64 serverNow);
+	static Body Evaluate(const Segment& segment);
+	void Show(const Body& body);
+
+private:
+	struct Sample
+	{
+		uint64 time;
+		Body body;
+	};
+
+	Body Blend(float deltaTime);
+	Segment SegmentAt(double time) const;
+
+	Sample samples[bufferSize];
+	uint32 sampleCount;
+	uint64 lastArrival;
+	float interval;		// mean ms between the server times of consecutive states
+	float jitter;		// mean deviation of the arrival intervals from the server intervals
+	float delay;
+	double renderTime;
+	Body shown;
+	glm::vec3 correction;	// the jump a late state caused, faded out over the next frames
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,144 @@
+#include "config.h"
+#include "interpolation.h"
+#include <algorithm>
+
+namespace Game
+{
+	void InterpolationBatch::Clear()
+	{
+		// the lanes keep their size, they are only grown
+		count = 0;
+	}
+
+	void InterpolationBatch::Add(const DeadReck::Segment& segment)
+	{
+		const DeadReck::Body& a = segment.a;
+		const DeadReck::Body& b = segment.b;
+		const float values[] = {
+			a.position.x, a.position.y, a.position.z, a.velocity.x, a.velocity.y, a.velocity.z,
+			a.orientation.x, a.orientation.y, a.orientation.z, a.orientation.w,
+			b.position.x, b.position.y, b.position.z, b.velocity.x, b.velocity.y, b.velocity.z,
+			b.orientation.x, b.orientation.y, b.orientation.z, b.orientation.w,
+			segment.correction.x, segment.correction.y, segment.correction.z, segment.t, segment.span
+		};
+		if (count + 4 > lanes[AX].size())
+		{
+			size_t size = std::max<size_t>(64, lanes[AX].size() * 2);
+			for (std::vector<float>& lane : lanes)
+				lane.resize(size);
+			accelerations.resize(size);
+			transforms.resize(size);
+		}
+
+		for (int lane = 0; lane < PX; lane++)
+			lanes[lane][count] = values[lane];
+		accelerations[count] = b.acceleration;
+		count++;
+	}
+
+	void InterpolationBatch::Run()
+	{
+		// pad to a whole group of four, the padding is an identity orientation at the origin
+		size_t padded = (count + 3) & ~(size_t)3;
+		for (int lane = 0; lane < PX; lane++)
+			std::fill(lanes[lane].begin() + count, lanes[lane].begin() + padded, lane == AQW || lane == BQW ? 1.f : 0.f);
+
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 two = _mm_set1_ps(2.f);
+		const __m128 three = _mm_set1_ps(3.f);
+		const __m128 signMask = _mm_set1_ps(-0.f);
+		const __m128 velocityScale = _mm_set1_ps(DeadReck::velocityScale);
+		float* l[LaneCount];
+		for (int lane = 0; lane < LaneCount; lane++)
+			l[lane] = lanes[lane].data();
+
+		for (size_t i = 0; i < padded; i += 4)
+		{
+			// hermite basis
+			__m128 t = _mm_loadu_ps(l[T] + i);
+			__m128 tangent = _mm_mul_ps(_mm_loadu_ps(l[Span] + i), velocityScale);
+			__m128 t2 = _mm_mul_ps(t, t);
+			__m128 t3 = _mm_mul_ps(t2, t);
+			__m128 h01 = _mm_sub_ps(_mm_mul_ps(three, t2), _mm_mul_ps(two, t3));
+			__m128 h00 = _mm_sub_ps(one, h01);
+			__m128 h10 = _mm_mul_ps(tangent, _mm_add_ps(_mm_sub_ps(t3, _mm_mul_ps(two, t2)), t));
+			__m128 h11 = _mm_mul_ps(tangent, _mm_sub_ps(t3, t2));
+
+			__m128 position[3];
+			for (int c = 0; c < 3; c++)
+			{
+				__m128 a = _mm_loadu_ps(l[AX + c] + i);
+				__m128 av = _mm_loadu_ps(l[AVX + c] + i);
+				__m128 b = _mm_loadu_ps(l[BX + c] + i);
+				__m128 bv = _mm_loadu_ps(l[BVX + c] + i);
+				__m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, h00), _mm_mul_ps(av, h10)), _mm_add_ps(_mm_mul_ps(b, h01), _mm_mul_ps(bv, h11)));
+				position[c] = _mm_add_ps(p, _mm_loadu_ps(l[CX + c] + i));
+				_mm_storeu_ps(l[PX + c] + i, position[c]);
+				_mm_storeu_ps(l[VX + c] + i, _mm_add_ps(av, _mm_mul_ps(_mm_sub_ps(bv, av), t)));
+			}
+
+			// normalized lerp the shorter way round
+			__m128 aq[4], bq[4];
+			__m128 dot = _mm_setzero_ps();
+			for (int c = 0; c < 4; c++)
+			{
+				aq[c] = _mm_loadu_ps(l[AQX + c] + i);
+				bq[c] = _mm_loadu_ps(l[BQX + c] + i);
+				dot = _mm_add_ps(dot, _mm_mul_ps(aq[c], bq[c]));
+			}
+			__m128 flip = _mm_and_ps(dot, signMask);
+			__m128 q[4];
+			__m128 length = _mm_setzero_ps();
+			for (int c = 0; c < 4; c++)
+			{
+				q[c] = _mm_add_ps(aq[c], _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(bq[c], flip), aq[c]), t));
+				length = _mm_add_ps(length, _mm_mul_ps(q[c], q[c]));
+			}
+			__m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(length));
+			for (int c = 0; c < 4; c++)
+			{
+				q[c] = _mm_mul_ps(q[c], inverse);
+				_mm_storeu_ps(l[QX + c] + i, q[c]);
+			}
+
+			// translate(position) * mat4(orientation), m[column][row] with one ship per lane
+			__m128 x2 = _mm_add_ps(q[0], q[0]), y2 = _mm_add_ps(q[1], q[1]), z2 = _mm_add_ps(q[2], q[2]);
+			__m128 xx = _mm_mul_ps(q[0], x2), yy = _mm_mul_ps(q[1], y2), zz = _mm_mul_ps(q[2], z2);
+			__m128 xy = _mm_mul_ps(q[0], y2), xz = _mm_mul_ps(q[0], z2), yz = _mm_mul_ps(q[1], z2);
+			__m128 wx = _mm_mul_ps(q[3], x2), wy = _mm_mul_ps(q[3], y2), wz = _mm_mul_ps(q[3], z2);
+			__m128 zero = _mm_setzero_ps();
+			__m128 m[4][4] = {
+				{ _mm_sub_ps(one, _mm_add_ps(yy, zz)), _mm_add_ps(xy, wz), _mm_sub_ps(xz, wy), zero },
+				{ _mm_sub_ps(xy, wz), _mm_sub_ps(one, _mm_add_ps(xx, zz)), _mm_add_ps(yz, wx), zero },
+				{ _mm_add_ps(xz, wy), _mm_sub_ps(yz, wx), _mm_sub_ps(one, _mm_add_ps(xx, yy)), zero },
+				{ position[0], position[1], position[2], one }
+			};
+			for (int c = 0; c < 4; c++)
+			{
+				_MM_TRANSPOSE4_PS(m[c][0], m[c][1], m[c][2], m[c][3]);
+				for (int k = 0; k < 4; k++)
+					_mm_storeu_ps(&transforms[i + k][c][0], m[c][k]);
+			}
+		}
+	}
+
+	size_t InterpolationBatch::Size() const
+	{
+		return count;
+	}
+
+	DeadReck::Body InterpolationBatch::Body(size_t index) const
+	{
+		return {
+			glm::vec3(lanes[PX][index], lanes[PY][index], lanes[PZ][index]),
+			glm::vec3(lanes[VX][index], lanes[VY][index], lanes[VZ][index]),
+			accelerations[index],
+			glm::quat(lanes[QW][index], lanes[QX][index], lanes[QY][index], lanes[QZ][index])
+		};
+	}
+
+	const glm::mat4& InterpolationBatch::Transform(size_t index) const
+	{
+		return transforms[index];
+	}
+}
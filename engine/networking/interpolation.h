@@ -0,0 +1,37 @@
+#pragma once
+#include "dead_reck.h"
+#include <vector>
+
+namespace Game
+{
+	// Evaluates the DeadReck segments of many ships in one pass. The segments are copied into one array per
+	// component and worked on four ships at a time with SSE, positions, orientations and the ships' transforms.
+	// Orientations are normalized lerps, which stay within float precision of DeadReck::Evaluate's slerp for the
+	// small angles between consecutive states.
+	class InterpolationBatch
+	{
+	public:
+		void Clear();
+		void Add(const DeadReck::Segment& segment);
+		void Run();
+
+		size_t Size() const;
+		DeadReck::Body Body(size_t index) const;
+		const glm::mat4& Transform(size_t index) const;
+
+	private:
+		enum Lane
+		{
+			AX, AY, AZ, AVX, AVY, AVZ, AQX, AQY, AQZ, AQW,
+			BX, BY, BZ, BVX, BVY, BVZ, BQX, BQY, BQZ, BQW,
+			CX, CY, CZ, T, Span,
+			PX, PY, PZ, VX, VY, VZ, QX, QY, QZ, QW,
+			LaneCount
+		};
+
+		std::vector<float> lanes[LaneCount];
+		std::vector<glm::vec3> accelerations;
+		std::vector<glm::mat4> transforms;
+		size_t count = 0;
+	};
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+namespace Game
+{
+	// Positions of one entity over the last SIZE server ticks, for testing hits against where a client saw it.
+	// Entries are addressed by tick, so a lookup is two slots and a lerp no matter how far back it goes.
+	template<uint32 SIZE = 64>
+	class PositionHistory
+	{
+	public:
+		void Record(uint32 tick, const glm::vec3& position)
+		{
+			Entry& entry = entries[tick % SIZE];
+			entry.tick = tick;
+			entry.position = position;
+		}
+
+		// Position at a fractional tick, false if either neighbouring tick is not (or no longer) recorded.
+		bool Sample(float tick, glm::vec3& position) const
+		{
+			if (tick < 1.f)
+				return false;
+
+			uint32 before = (uint32)tick;
+			const Entry& a = entries[before % SIZE];
+			const Entry& b = entries[(before + 1) % SIZE];
+			if (a.tick != before)
+				return false;
+
+			float t = tick - (float)before;
+			if (b.tick != before + 1)
+			{
+				// the newest recorded tick, nothing to blend towards
+				if (t > 0.f)
+					return false;
+				position = a.position;
+				return true;
+			}
+
+			position = glm::mix(a.position, b.position, t);
+			return true;
+		}
+
+		void Clear()
+		{
+			for (Entry& entry : entries)
+				entry.tick = 0;
+		}
+
+	private:
+		struct Entry
+		{
+			uint32 tick = 0;
+			glm::vec3 position = glm::vec3(0.f);
+		};
+
+		Entry entries[SIZE];
+	};
+}
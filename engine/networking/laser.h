@@ -1,5 +1,4 @@
 #pragma once
-#include "render/model.h"
 
 namespace Game
 {
@@ -13,6 +12,9 @@ struct Laser
 
 	const uint32 spaceShipId;
 
+	// server only, how many ms behind the shooter saw the other ships when it fired
+	uint32 rewind = 0;
+
 	Laser(uint32 _id, uint64 _startTime, uint64 _endTime, const glm::vec3& _origin, const glm::quat& _direction, uint32 _spaceShipId);
 	~Laser();
 
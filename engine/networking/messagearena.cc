@@ -0,0 +1,85 @@
+#include "config.h"
+#include "messagearena.h"
+
+namespace Game
+{
+#pragma region allocator
+	ArenaAllocator::ArenaAllocator(size_t _chunkSize) :
+		chunkIndex(0),
+		offset(0),
+		chunkSize(_chunkSize),
+		misses(0)
+	{}
+
+	ArenaAllocator::~ArenaAllocator()
+	{
+		for (Chunk& chunk : chunks)
+			delete[] chunk.data;
+	}
+
+	uint8_t* ArenaAllocator::allocate(size_t size)
+	{
+		// keep every block aligned for the largest scalar a builder writes
+		size = (size + 15) & ~(size_t)15;
+
+		while (chunkIndex < chunks.size() && offset + size > chunks[chunkIndex].size)
+		{
+			chunkIndex++;
+			offset = 0;
+		}
+
+		if (chunkIndex == chunks.size())
+		{
+			size_t newSize = size > chunkSize ? size : chunkSize;
+			chunks.push_back({ new uint8_t[newSize], newSize });
+			offset = 0;
+			misses++;
+		}
+
+		uint8_t* block = chunks[chunkIndex].data + offset;
+		offset += size;
+		return block;
+	}
+
+	void ArenaAllocator::deallocate(uint8_t*, size_t)
+	{
+		// given back by Rewind
+	}
+
+	void ArenaAllocator::Rewind()
+	{
+		chunkIndex = 0;
+		offset = 0;
+	}
+#pragma endregion allocator
+
+#pragma region arena
+	MessageArena::MessageArena(size_t _initialSize, size_t _chunkSize) :
+		allocator(_chunkSize),
+		used(0),
+		initialSize(_initialSize)
+	{}
+
+	flatbuffers::FlatBufferBuilder& MessageArena::Acquire()
+	{
+		if (used == builders.size())
+			builders.push_back(std::make_unique<flatbuffers::FlatBufferBuilder>(initialSize, &allocator, false));
+
+		return *builders[used++];
+	}
+
+	void MessageArena::Reset()
+	{
+		// the builders drop their buffers, which are handed out again from the start of the arena
+		for (size_t i = 0; i < used; i++)
+			builders[i]->Reset();
+		used = 0;
+		allocator.Rewind();
+	}
+
+	size_t MessageArena::Misses() const
+	{
+		return allocator.misses;
+	}
+#pragma endregion arena
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "flatbuffers/flatbuffers.h"
+#include <vector>
+#include <memory>
+
+namespace Game
+{
+	// Bump allocator the builders of a MessageArena serialize into. Memory is only given back all at once
+	// by Rewind, chunks are kept so a tick that fits into the last tick's high-water mark allocates nothing.
+	class ArenaAllocator : public flatbuffers::Allocator
+	{
+	private:
+		struct Chunk
+		{
+			uint8_t* data;
+			size_t size;
+		};
+
+		std::vector<Chunk> chunks;
+		size_t chunkIndex;
+		size_t offset;
+		const size_t chunkSize;
+
+	public:
+		size_t misses;		// chunks allocated since construction, stops growing once the arena is warm
+
+		ArenaAllocator(size_t _chunkSize);
+		~ArenaAllocator();
+
+		uint8_t* allocate(size_t size) override;
+		void deallocate(uint8_t* p, size_t size) override;
+		void Rewind();
+	};
+
+	// Hands out FlatBufferBuilders for outgoing messages. Acquire gives the next unused builder, Reset at the
+	// end of a tick drops everything built since the last Reset. Buffers stay valid until then, SendData copies them.
+	class MessageArena
+	{
+	private:
+		ArenaAllocator allocator;
+		std::vector<std::unique_ptr<flatbuffers::FlatBufferBuilder>> builders;
+		size_t used;
+		const size_t initialSize;
+
+	public:
+		MessageArena(size_t _initialSize = 1024, size_t _chunkSize = 64 * 1024);
+
+		flatbuffers::FlatBufferBuilder& Acquire();
+		void Reset();
+		size_t Misses() const;
+	};
+}
@@ -0,0 +1,132 @@
+#include "config.h"
+#include "netrecorder.h"
+#include <cstring>
+
+namespace Game
+{
+	static const char logMagic[4] = { 'N', 'R', 'E', 'C' };
+	static const enet_uint32 logVersion = 1;
+	static const size_t logBufferSize = 1 << 20;
+
+#pragma region recorder
+	NetRecorder::NetRecorder() :
+		file(nullptr),
+		startTime(0)
+	{}
+
+	NetRecorder::~NetRecorder()
+	{
+		Close();
+	}
+
+	bool NetRecorder::Open(const char* path)
+	{
+		Close();
+
+		file = fopen(path, "wb");
+		if (file == nullptr)
+		{
+			printf("\n[ERROR] failed to open traffic log %s for writing.\n", path);
+			return false;
+		}
+
+		buffer.resize(logBufferSize);
+		setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+		fwrite(logMagic, sizeof(logMagic), 1, file);
+		fwrite(&logVersion, sizeof(logVersion), 1, file);
+		startTime = enet_time_get();
+		return true;
+	}
+
+	void NetRecorder::Close()
+	{
+		if (file == nullptr)
+			return;
+
+		fclose(file);
+		file = nullptr;
+	}
+
+	bool NetRecorder::IsOpen() const
+	{
+		return file != nullptr;
+	}
+
+	void NetRecorder::Write(NetRecord::Type type, ENetPeer* peer, enet_uint8 channel, const void* data, size_t dataSize)
+	{
+		if (file == nullptr)
+			return;
+
+		NetRecord record;
+		record.time = enet_time_get() - startTime;
+		record.peer = peer != nullptr ? peer->incomingPeerID : 0;
+		record.type = type;
+		record.channel = channel;
+		record.dataSize = (enet_uint32)dataSize;
+		fwrite(&record, sizeof(record), 1, file);
+		if (dataSize > 0)
+			fwrite(data, dataSize, 1, file);
+	}
+#pragma endregion recorder
+
+#pragma region playback
+	NetPlayback::NetPlayback() :
+		file(nullptr)
+	{}
+
+	NetPlayback::~NetPlayback()
+	{
+		Close();
+	}
+
+	bool NetPlayback::Open(const char* path)
+	{
+		Close();
+
+		file = fopen(path, "rb");
+		if (file == nullptr)
+		{
+			printf("\n[ERROR] failed to open traffic log %s.\n", path);
+			return false;
+		}
+
+		buffer.resize(logBufferSize);
+		setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+		char magic[4];
+		enet_uint32 version;
+		if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, logMagic, sizeof(magic)) != 0 ||
+			fread(&version, sizeof(version), 1, file) != 1 || version != logVersion)
+		{
+			printf("\n[ERROR] %s is not a traffic log of this version.\n", path);
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void NetPlayback::Close()
+	{
+		if (file == nullptr)
+			return;
+
+		fclose(file);
+		file = nullptr;
+	}
+
+	bool NetPlayback::IsOpen() const
+	{
+		return file != nullptr;
+	}
+
+	bool NetPlayback::Next(NetRecord& record, std::vector<enet_uint8>& data)
+	{
+		if (file == nullptr || fread(&record, sizeof(record), 1, file) != 1)
+			return false;
+
+		data.resize(record.dataSize);
+		return record.dataSize == 0 || fread(data.data(), record.dataSize, 1, file) == 1;
+	}
+#pragma endregion playback
+}
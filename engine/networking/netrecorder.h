@@ -0,0 +1,64 @@
+#pragma once
+#include "enet/enet.h"
+#include <vector>
+#include <cstdio>
+
+namespace Game
+{
+	// Header of one entry in a traffic log, followed by dataSize bytes of payload. An Update entry closes
+	// the batch of events one Host::Update handed to the application.
+	struct NetRecord
+	{
+		enum class Type : enet_uint8
+		{
+			Update,
+			Connect,
+			Disconnect,
+			Receive,		// a whole packet as it came off the wire
+			Send			// a single message as the application sent it
+		};
+
+		enet_uint32 time = 0;		// ms since the recording started
+		enet_uint16 peer = 0;		// the peer's incoming id, stable while it stays connected
+		Type type = Type::Update;
+		enet_uint8 channel = 0;
+		enet_uint32 dataSize = 0;
+	};
+
+	// Appends the traffic of a host to a binary log through a large stdio buffer, so recording a match
+	// costs a memcpy per packet and a write every few hundred kilobytes.
+	class NetRecorder
+	{
+	private:
+		FILE* file;
+		enet_uint32 startTime;
+		std::vector<char> buffer;
+
+	public:
+		NetRecorder();
+		~NetRecorder();
+
+		bool Open(const char* path);
+		void Close();
+		bool IsOpen() const;
+		void Write(NetRecord::Type type, ENetPeer* peer, enet_uint8 channel, const void* data, size_t dataSize);
+	};
+
+	// Reads a log written by NetRecorder back one record at a time.
+	class NetPlayback
+	{
+	private:
+		FILE* file;
+		std::vector<char> buffer;
+
+	public:
+		NetPlayback();
+		~NetPlayback();
+
+		bool Open(const char* path);
+		void Close();
+		bool IsOpen() const;
+		// false at the end of the log or on a truncated record
+		bool Next(NetRecord& record, std::vector<enet_uint8>& data);
+	};
+}
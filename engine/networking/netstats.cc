@@ -0,0 +1,240 @@
+#include "config.h"
+#include "netstats.h"
+#include "core/cvar.h"
+#ifndef HEADLESS
+#include "imgui.h"
+#endif
+
+namespace Game
+{
+	// counters of a peer pointer that was reused by a new connection start over
+	static uint64 Rate(uint64 current, uint64 previous, float seconds)
+	{
+		return (uint64)((float)(current >= previous ? current - previous : current) / seconds);
+	}
+
+	static std::string PeerName(ENetPeer* peer)
+	{
+		char ip[64];
+		if (enet_address_get_host_ip(&peer->address, ip, sizeof(ip)) != 0)
+			return "unknown";
+		return std::string(ip) + ":" + std::to_string(peer->address.port);
+	}
+
+	NetStats::NetStats() :
+		lastReport(0),
+		csv(nullptr)
+	{}
+
+	NetStats::~NetStats()
+	{
+		if (csv != nullptr)
+			fclose(csv);
+	}
+
+	void NetStats::SetMessageTypes(const char* const* names, size_t count, std::function<size_t(const enet_uint8*, size_t)> _classify)
+	{
+		messageTypeNames.assign(names, names + count);
+		classify = _classify;
+		messages.assign(count, MessageStats());
+		lastMessages.assign(count, MessageStats());
+	}
+
+	void NetStats::CountMessageIn(const enet_uint8* data, size_t byteSize)
+	{
+		if (classify == nullptr)
+			return;
+
+		size_t type = classify(data, byteSize);
+		if (type >= messages.size())
+			return;
+
+		messages[type].messagesIn++;
+		messages[type].bytesIn += byteSize;
+	}
+
+	void NetStats::CountMessageOut(const void* data, size_t byteSize)
+	{
+		if (classify == nullptr)
+			return;
+
+		size_t type = classify((const enet_uint8*)data, byteSize);
+		if (type >= messages.size())
+			return;
+
+		messages[type].messagesOut++;
+		messages[type].bytesOut += byteSize;
+	}
+
+	void NetStats::Report(uint64 currentTimeMillis)
+	{
+		if (lastReport != 0 && currentTimeMillis - lastReport < 1000)
+			return;
+
+		// the first call only sets the baseline
+		if (lastReport != 0)
+		{
+			float seconds = (float)(currentTimeMillis - lastReport) / 1000.f;
+
+			peerRows.clear();
+			for (auto& [peer, current] : peers)
+			{
+				auto previous = lastPeers.find(peer);
+				PeerStats last = previous != lastPeers.end() ? previous->second : PeerStats();
+
+				Row row;
+				row.name = PeerName(peer);
+				row.peer = current;
+				row.peer.bytesIn = Rate(current.bytesIn, last.bytesIn, seconds);
+				row.peer.bytesOut = Rate(current.bytesOut, last.bytesOut, seconds);
+				row.peer.packetsIn = Rate(current.packetsIn, last.packetsIn, seconds);
+				row.peer.packetsOut = Rate(current.packetsOut, last.packetsOut, seconds);
+				peerRows.push_back(row);
+			}
+
+			messageRows.clear();
+			for (size_t i = 0; i < messages.size(); i++)
+			{
+				Row row;
+				row.name = messageTypeNames[i];
+				row.message.messagesIn = Rate(messages[i].messagesIn, lastMessages[i].messagesIn, seconds);
+				row.message.bytesIn = Rate(messages[i].bytesIn, lastMessages[i].bytesIn, seconds);
+				row.message.messagesOut = Rate(messages[i].messagesOut, lastMessages[i].messagesOut, seconds);
+				row.message.bytesOut = Rate(messages[i].bytesOut, lastMessages[i].bytesOut, seconds);
+				messageRows.push_back(row);
+			}
+
+			PublishCVars();
+			WriteCsv(currentTimeMillis);
+		}
+
+		lastReport = currentTimeMillis;
+		lastPeers = peers;
+		lastMessages = messages;
+	}
+
+	void NetStats::PublishCVars()
+	{
+		PeerStats total;
+		uint64 rttSum = 0, rttVarianceSum = 0;
+		float lossSum = 0.f;
+		for (const Row& row : peerRows)
+		{
+			total.bytesIn += row.peer.bytesIn;
+			total.bytesOut += row.peer.bytesOut;
+			total.packetsIn += row.peer.packetsIn;
+			total.packetsOut += row.peer.packetsOut;
+			rttSum += row.peer.roundTripTime;
+			rttVarianceSum += row.peer.roundTripTimeVariance;
+			lossSum += row.peer.packetLoss;
+		}
+		size_t count = peerRows.empty() ? 1 : peerRows.size();
+
+		Core::CVarWriteInt(Core::CVarCreate(Core::CVar_Int, "net_bytes_in", "0", "bytes per second received from all peers"), (int)total.bytesIn);
+		Core::CVarWriteInt(Core::CVarCreate(Core::CVar_Int, "net_bytes_out", "0", "bytes per second sent to all peers"), (int)total.bytesOut);
+		Core::CVarWriteInt(Core::CVarCreate(Core::CVar_Int, "net_packets_in", "0", "packets per second received from all peers"), (int)total.packetsIn);
+		Core::CVarWriteInt(Core::CVarCreate(Core::CVar_Int, "net_packets_out", "0", "packets per second sent to all peers"), (int)total.packetsOut);
+		Core::CVarWriteInt(Core::CVarCreate(Core::CVar_Int, "net_rtt", "0", "mean round trip time of all peers in ms"), (int)(rttSum / count));
+		Core::CVarWriteInt(Core::CVarCreate(Core::CVar_Int, "net_rtt_variance", "0", "mean round trip time variance of all peers in ms"), (int)(rttVarianceSum / count));
+		Core::CVarWriteFloat(Core::CVarCreate(Core::CVar_Float, "net_packet_loss", "0", "mean reliable packet loss of all peers, 0..1"), lossSum / (float)count);
+
+		for (const Row& row : messageRows)
+		{
+			std::string name = "net_msg_" + row.name;
+			Core::CVarWriteInt(Core::CVarCreate(Core::CVar_Int, (name + "_in").c_str(), "0", "bytes per second received of this message type"), (int)row.message.bytesIn);
+			Core::CVarWriteInt(Core::CVarCreate(Core::CVar_Int, (name + "_out").c_str(), "0", "bytes per second sent of this message type"), (int)row.message.bytesOut);
+		}
+	}
+
+	void NetStats::WriteCsv(uint64 currentTimeMillis)
+	{
+		const char* path = Core::CVarReadString(Core::CVarCreate(Core::CVar_String, "net_stats_csv", "", "file the network stats are appended to once a second, empty to disable"));
+		if (csvPath != path)
+		{
+			if (csv != nullptr)
+				fclose(csv);
+			csv = nullptr;
+			csvPath = path;
+
+			if (!csvPath.empty())
+			{
+				csv = fopen(path, "w");
+				if (csv == nullptr)
+					printf("\n[WARNING] could not open network stats file '%s'.\n", path);
+				else
+					fprintf(csv, "time_ms,scope,name,count_in,bytes_in,count_out,bytes_out,rtt_ms,rtt_variance_ms,packet_loss\n");
+			}
+		}
+
+		if (csv == nullptr)
+			return;
+
+		// peers count packets, message types count messages, all per second
+		for (const Row& row : peerRows)
+		{
+			fprintf(csv, "%llu,peer,%s,%llu,%llu,%llu,%llu,%u,%u,%.4f\n", (unsigned long long)currentTimeMillis, row.name.c_str(),
+				(unsigned long long)row.peer.packetsIn, (unsigned long long)row.peer.bytesIn,
+				(unsigned long long)row.peer.packetsOut, (unsigned long long)row.peer.bytesOut,
+				row.peer.roundTripTime, row.peer.roundTripTimeVariance, row.peer.packetLoss);
+		}
+		for (const Row& row : messageRows)
+		{
+			fprintf(csv, "%llu,message,%s,%llu,%llu,%llu,%llu,,,\n", (unsigned long long)currentTimeMillis, row.name.c_str(),
+				(unsigned long long)row.message.messagesIn, (unsigned long long)row.message.bytesIn,
+				(unsigned long long)row.message.messagesOut, (unsigned long long)row.message.bytesOut);
+		}
+		fflush(csv);
+	}
+
+	void NetStats::Draw()
+	{
+#ifndef HEADLESS
+		if (!ImGui::CollapsingHeader("Network"))
+			return;
+
+		if (ImGui::BeginTable("peers", 8, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		{
+			const char* headers[8] = { "peer", "pkt/s in", "B/s in", "pkt/s out", "B/s out", "rtt", "rtt var", "loss" };
+			for (const char* header : headers)
+				ImGui::TableSetupColumn(header);
+			ImGui::TableHeadersRow();
+
+			for (const Row& row : peerRows)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(row.name.c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.peer.packetsIn);
+				ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.peer.bytesIn);
+				ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.peer.packetsOut);
+				ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.peer.bytesOut);
+				ImGui::TableNextColumn(); ImGui::Text("%u", row.peer.roundTripTime);
+				ImGui::TableNextColumn(); ImGui::Text("%u", row.peer.roundTripTimeVariance);
+				ImGui::TableNextColumn(); ImGui::Text("%.1f%%", row.peer.packetLoss * 100.f);
+			}
+			ImGui::EndTable();
+		}
+
+		if (ImGui::BeginTable("messages", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		{
+			const char* headers[5] = { "message", "msg/s in", "B/s in", "msg/s out", "B/s out" };
+			for (const char* header : headers)
+				ImGui::TableSetupColumn(header);
+			ImGui::TableHeadersRow();
+
+			for (const Row& row : messageRows)
+			{
+				if (row.message.messagesIn == 0 && row.message.messagesOut == 0)
+					continue;
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(row.name.c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.message.messagesIn);
+				ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.message.bytesIn);
+				ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.message.messagesOut);
+				ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.message.bytesOut);
+			}
+			ImGui::EndTable();
+		}
+#endif
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "enet/enet.h"
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <string>
+#include <cstdio>
+
+namespace Game
+{
+	// Traffic counters of one Host, per peer and per message type. Everything in here belongs to the game thread,
+	// the host copies the per peer numbers over from whichever thread services ENet.
+	class NetStats
+	{
+	public:
+		struct PeerStats
+		{
+			uint64 bytesIn = 0;
+			uint64 bytesOut = 0;
+			uint64 packetsIn = 0;
+			uint64 packetsOut = 0;
+			uint32 roundTripTime = 0;
+			uint32 roundTripTimeVariance = 0;
+			float packetLoss = 0.f;		// mean loss of reliable packets, 0..1
+		};
+
+		struct MessageStats
+		{
+			uint64 messagesIn = 0;
+			uint64 bytesIn = 0;
+			uint64 messagesOut = 0;
+			uint64 bytesOut = 0;
+		};
+
+		std::unordered_map<ENetPeer*, PeerStats> peers;
+		std::vector<MessageStats> messages;
+
+		NetStats();
+		~NetStats();
+
+		// Message types are told apart by the application, names[classify(message)] names the type of a message.
+		void SetMessageTypes(const char* const* names, size_t count, std::function<size_t(const enet_uint8*, size_t)> classify);
+		void CountMessageIn(const enet_uint8* data, size_t byteSize);
+		void CountMessageOut(const void* data, size_t byteSize);
+
+		// Once a second publishes the rates of the last second to the net_ cvars and appends them to net_stats_csv.
+		void Report(uint64 currentTimeMillis);
+		// ImGui tables of the last report, call inside a window.
+		void Draw();
+
+	private:
+		struct Row
+		{
+			std::string name;
+			PeerStats peer;
+			MessageStats message;
+		};
+
+		std::vector<const char*> messageTypeNames;
+		std::function<size_t(const enet_uint8*, size_t)> classify;
+
+		uint64 lastReport;
+		std::unordered_map<ENetPeer*, PeerStats> lastPeers;
+		std::vector<MessageStats> lastMessages;
+		std::vector<Row> peerRows;
+		std::vector<Row> messageRows;
+
+		FILE* csv;
+		std::string csvPath;
+
+		void PublishCVars();
+		void WriteCsv(uint64 currentTimeMillis);
+	};
+}
@@ -1,5 +1,9 @@
 #include "config.h"
 #include "network.h"
+#include "core/cvar.h"
+#include "core/random.h"
+#include <cstring>
+#include <algorithm>
 
 namespace Game
 {
@@ -28,36 +32,110 @@ namespace Game
 		}
 	}
 
-#pragma region data
+	// messages inside a packet are prefixed with their size as a LEB128 varint
+	static size_t WriteVarint(enet_uint8* out, size_t value)
+	{
+		size_t count = 0;
+		do
+		{
+			enet_uint8 byte = value & 0x7F;
+			value >>= 7;
+			out[count++] = byte | (value != 0 ? 0x80 : 0);
+		} while (value != 0);
+		return count;
+	}
 
-	PeerData::PeerData()
+	static bool ReadVarint(const enet_uint8* data, size_t dataSize, size_t& offset, size_t& value)
 	{
-		sender = nullptr;
+		value = 0;
+		for (size_t shift = 0; offset < dataSize && shift < 64; shift += 7)
+		{
+			enet_uint8 byte = data[offset++];
+			value |= (size_t)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
 	}
 
-	PeerData::PeerData(ENetPeer* _sender, enet_uint8* _data, size_t dataSize)
+	// largest packet ENet sends to this peer without fragmenting it
+	static size_t DatagramBudget(ENetPeer* peer)
 	{
-		sender = _sender;
-		data = std::make_shared<std::vector<enet_uint8>>();
-		data->reserve(dataSize);
-		for (size_t i = 0; i < dataSize; i++)
-			data->push_back(_data[i]);
+		size_t budget = peer->mtu - sizeof(ENetProtocolHeader) - sizeof(ENetProtocolSendFragment);
+		if (peer->host->checksum != nullptr)
+			budget -= sizeof(enet_uint32);
+		return budget;
 	}
 
-	PeerData::PeerData(const PeerData& other) //Copy
+#pragma region data
+
+	PeerData::PeerData() :
+		sender(nullptr),
+		data(nullptr),
+		dataSize(0)
+	{}
+
+	PeerData::PeerData(ENetPeer* _sender, enet_uint8* _data, size_t _dataSize) :
+		sender(_sender),
+		data(_data),
+		dataSize(_dataSize)
+	{}
+
+	PacketPool::PacketPool(size_t _slabSize, size_t _slabsPerChunk) :
+		slabsPerChunk(_slabsPerChunk),
+		slabSize(_slabSize),
+		hits(0),
+		misses(0)
+	{}
+
+	PacketPool::~PacketPool()
 	{
-		sender = other.sender;
-		data = other.data;
+		for (enet_uint8* chunk : chunks)
+			delete[] chunk;
 	}
 
-	PeerData& PeerData::operator=(const PeerData& other)
+	void PacketPool::Grow()
 	{
-		sender = other.sender;
-		data = other.data;
-		return *this;
+		enet_uint8* chunk = new enet_uint8[slabSize * slabsPerChunk];
+		chunks.push_back(chunk);
+		freeSlabs.reserve(chunks.size() * slabsPerChunk);
+		for (size_t i = 0; i < slabsPerChunk; i++)
+			freeSlabs.push_back(chunk + i * slabSize);
 	}
 
-	PeerData::~PeerData() {}
+	enet_uint8* PacketPool::Acquire(size_t byteSize)
+	{
+		if (byteSize > slabSize)
+		{
+			misses++;
+			return new enet_uint8[byteSize];
+		}
+
+		if (freeSlabs.empty())
+		{
+			misses++;
+			Grow();
+		}
+		else
+		{
+			hits++;
+		}
+
+		enet_uint8* slab = freeSlabs.back();
+		freeSlabs.pop_back();
+		return slab;
+	}
+
+	void PacketPool::Release(enet_uint8* block, size_t byteSize)
+	{
+		if (block == nullptr)
+			return;
+
+		if (byteSize > slabSize)
+			delete[] block;
+		else
+			freeSlabs.push_back(block);
+	}
 
 #pragma endregion data
 
@@ -65,46 +143,295 @@ namespace Game
 
 	Host::Host(HostType _type) :
 		type(_type),
-		host(nullptr)
+		host(nullptr),
+		dataStackRead(0),
+		serviceRunning(false),
+		inbound(4096),
+		outbound(4096),
+		lastWireSample(0),
+		replayRealTime(false),
+		replayPending(false),
+		replayStart(0),
+		receivePool(ENET_HOST_DEFAULT_MTU, 64),
+		bulkBudget(4096)
 	{}
 
 	Host::~Host()
 	{
+		StopServiceThread();
+
+		receivePool.Release(poppedData.data, poppedData.dataSize);
+		for (size_t i = dataStackRead; i < dataStack.size(); i++)
+			receivePool.Release(dataStack[i].data, dataStack[i].dataSize);
+
 		enet_host_destroy(host);
 	}
 
+	bool Host::StartServiceThread()
+	{
+		if (host == nullptr)
+		{
+			printf("\n[ERROR] tried to start the network thread before the host was created.\n");
+			return false;
+		}
+
+		if (IsThreaded())
+			return true;
+
+		serviceRunning.store(true, std::memory_order_release);
+		serviceThread = std::thread(&Host::ServiceLoop, this);
+		return true;
+	}
+
+	void Host::StopServiceThread()
+	{
+		if (!IsThreaded())
+			return;
+
+		serviceRunning.store(false, std::memory_order_release);
+		serviceThread.join();
+
+		// the game thread owns ENet again, send whatever the service thread did not get to
+		NetEvent* command;
+		while ((command = outbound.Peek()) != nullptr)
+		{
+			if (command->type == NetEvent::Type::Send)
+				QueueData(command->data.data(), command->data.size(), command->peer, command->channel);
+			else if (command->type == NetEvent::Type::SendAlone)
+				QueueDataAlone(command->data.data(), command->data.size(), command->peer);
+			else
+				FlushQueues();
+			outbound.Pop();
+		}
+	}
+
+	bool Host::IsThreaded() const
+	{
+		return serviceThread.joinable();
+	}
+
+	void Host::ServiceLoop()
+	{
+		while (serviceRunning.load(std::memory_order_acquire))
+		{
+			NetEvent* command;
+			while ((command = outbound.Peek()) != nullptr)
+			{
+				if (command->type == NetEvent::Type::Send)
+					QueueData(command->data.data(), command->data.size(), command->peer, command->channel);
+				else if (command->type == NetEvent::Type::SendAlone)
+					QueueDataAlone(command->data.data(), command->data.size(), command->peer);
+				else
+					FlushQueues();
+				outbound.Pop();
+			}
+
+			// wait on the socket for at most a millisecond so queued messages go out promptly
+			ENetEvent event;
+			int result = enet_host_service(host, &event, 1);
+			while (result > 0)
+			{
+				switch (event.type)
+				{
+				case ENET_EVENT_TYPE_CONNECT:
+					PushInbound(NetEvent::Type::Connect, event.peer, nullptr, 0, Channel::Events);
+					break;
+				case ENET_EVENT_TYPE_RECEIVE:
+					CountPacketIn(event.peer, event.packet->dataLength);
+					PushInbound(NetEvent::Type::Receive, event.peer, event.packet->data, event.packet->dataLength, (Channel)event.channelID);
+					enet_packet_destroy(event.packet);
+					break;
+				case ENET_EVENT_TYPE_DISCONNECT:
+					outgoing.erase(event.peer);
+					wireStats.erase(event.peer);
+					PushInbound(NetEvent::Type::Disconnect, event.peer, nullptr, 0, Channel::Events);
+					break;
+				default:
+					break;
+				}
+				result = enet_host_service(host, &event, 0);
+			}
+
+			// hand the packet counters to the game thread a few times a second
+			if (enet_time_get() - lastWireSample >= 100)
+			{
+				SampleWireStats();
+				for (auto& [peer, peerStats] : wireStats)
+					PushInbound(NetEvent::Type::Stats, peer, (const enet_uint8*)&peerStats, sizeof(peerStats), Channel::Events);
+			}
+		}
+	}
+
+	void Host::PushInbound(NetEvent::Type type, ENetPeer* peer, const enet_uint8* data, size_t dataSize, Channel channel)
+	{
+		// the game thread is behind, wait for it unless we are shutting down
+		NetEvent* slot;
+		while ((slot = inbound.Reserve()) == nullptr)
+		{
+			if (!serviceRunning.load(std::memory_order_acquire))
+				return;
+			std::this_thread::yield();
+		}
+
+		slot->type = type;
+		slot->peer = peer;
+		slot->channel = channel;
+		slot->data.assign(data, data + dataSize);
+		inbound.Commit();
+	}
+
+	void Host::PushOutbound(NetEvent::Type type, ENetPeer* peer, const void* data, size_t byteSize, Channel channel)
+	{
+		NetEvent* slot;
+		while ((slot = outbound.Reserve()) == nullptr)
+			std::this_thread::yield();
+
+		slot->type = type;
+		slot->peer = peer;
+		slot->channel = channel;
+		slot->data.assign((const enet_uint8*)data, (const enet_uint8*)data + byteSize);
+		outbound.Commit();
+	}
+
 	void Host::Update()
 	{
+		if (IsReplaying())
+		{
+			UpdateReplay();
+			return;
+		}
+
+		OnUpdate();
+
+		// events received by the service thread, also drains leftovers after it was stopped
+		NetEvent* received;
+		while ((received = inbound.Peek()) != nullptr)
+		{
+			switch (received->type)
+			{
+			case NetEvent::Type::Connect:
+				recorder.Write(NetRecord::Type::Connect, received->peer, 0, nullptr, 0);
+				OnConnect(received->peer);
+				break;
+			case NetEvent::Type::Receive:
+				recorder.Write(NetRecord::Type::Receive, received->peer, (enet_uint8)received->channel, received->data.data(), received->data.size());
+				ReceivePacket(received->peer, received->data.data(), received->data.size());
+				break;
+			case NetEvent::Type::Disconnect:
+				recorder.Write(NetRecord::Type::Disconnect, received->peer, 0, nullptr, 0);
+				OnDisconnect(received->peer);
+				stats.peers.erase(received->peer);
+				break;
+			case NetEvent::Type::Stats:
+				memcpy(&stats.peers[received->peer], received->data.data(), sizeof(NetStats::PeerStats));
+				break;
+			default:
+				break;
+			}
+			inbound.Pop();
+		}
+
+		// nothing to service once a replay has finished, or if the host was never created
+		if (host == nullptr)
+			return;
+
+		if (IsThreaded())
+		{
+			recorder.Write(NetRecord::Type::Update, nullptr, 0, nullptr, 0);
+			return;
+		}
+
 		ENetEvent event;
 		while (enet_host_service(host, &event, 0) > 0)
 		{
 			switch (event.type)
 			{
 			case ENET_EVENT_TYPE_CONNECT:
+				recorder.Write(NetRecord::Type::Connect, event.peer, 0, nullptr, 0);
 				OnConnect(event.peer);
 				break;
 			case ENET_EVENT_TYPE_RECEIVE:
-				dataStack.push_back(PeerData(event.peer, event.packet->data, event.packet->dataLength));
+				recorder.Write(NetRecord::Type::Receive, event.peer, event.channelID, event.packet->data, event.packet->dataLength);
+				CountPacketIn(event.peer, event.packet->dataLength);
+				ReceivePacket(event.peer, event.packet->data, event.packet->dataLength);
 				enet_packet_destroy(event.packet);
 				break;
 			case ENET_EVENT_TYPE_DISCONNECT:
+				recorder.Write(NetRecord::Type::Disconnect, event.peer, 0, nullptr, 0);
 				OnDisconnect(event.peer);
+				outgoing.erase(event.peer);
+				wireStats.erase(event.peer);
 				break;
 			}
 		}
+
+		SampleWireStats();
+		stats.peers = wireStats;
+		recorder.Write(NetRecord::Type::Update, nullptr, 0, nullptr, 0);
+	}
+
+	void Host::ReceivePacket(ENetPeer* sender, const enet_uint8* data, size_t dataSize)
+	{
+		// split the packet into the messages batched into it
+		size_t offset = 0;
+		while (offset < dataSize)
+		{
+			size_t messageSize;
+			if (!ReadVarint(data, dataSize, offset, messageSize) || messageSize > dataSize - offset)
+			{
+				printf("\n[ERROR] received malformed packet.\n");
+				return;
+			}
+
+			stats.CountMessageIn(data + offset, messageSize);
+			enet_uint8* message = receivePool.Acquire(messageSize);
+			memcpy(message, data + offset, messageSize);
+			dataStack.push_back(PeerData(sender, message, messageSize));
+			offset += messageSize;
+		}
 	}
 
 	bool Host::PopDataStack(PeerData& outData)
 	{
-		if (dataStack.size() == 0)
+		// the previously popped payload is handled by now, hand its slab back
+		receivePool.Release(poppedData.data, poppedData.dataSize);
+		poppedData = PeerData();
+
+		// messages are handed out in the order they were received
+		if (dataStackRead == dataStack.size())
+		{
+			dataStack.clear();
+			dataStackRead = 0;
 			return false;
+		}
 
-		outData = dataStack.back();
-		dataStack.pop_back();
+		poppedData = dataStack[dataStackRead++];
+		outData = poppedData;
 		return true;
 	}
 
-	void Host::SendData(void* data, size_t byteSize, ENetPeer* peer, ENetPacketFlag packetFlag)
+	void Host::SendData(void* data, size_t byteSize, ENetPeer* peer, Channel channel)
+	{
+		if (peer == nullptr)
+		{
+			printf("\n[ERROR] tried to send data to nullptr peer.\n");
+			return;
+		}
+
+		stats.CountMessageOut(data, byteSize);
+		recorder.Write(NetRecord::Type::Send, peer, (enet_uint8)channel, data, byteSize);
+
+		// a replaying host has no socket to send on
+		if (host == nullptr)
+			return;
+
+		if (IsThreaded())
+			PushOutbound(NetEvent::Type::Send, peer, data, byteSize, channel);
+		else
+			QueueData(data, byteSize, peer, channel);
+	}
+
+	void Host::SendDataAlone(void* data, size_t byteSize, ENetPeer* peer)
 	{
 		if (peer == nullptr)
 		{
@@ -112,11 +439,294 @@ namespace Game
 			return;
 		}
 
-		ENetPacket* packet = enet_packet_create(data, byteSize, packetFlag);
-		enet_peer_send(peer, 0, packet);
+		stats.CountMessageOut(data, byteSize);
+		recorder.Write(NetRecord::Type::Send, peer, (enet_uint8)Channel::Events, data, byteSize);
+
+		if (host == nullptr)
+			return;
+
+		if (IsThreaded())
+			PushOutbound(NetEvent::Type::SendAlone, peer, data, byteSize, Channel::Events);
+		else
+			QueueDataAlone(data, byteSize, peer);
+	}
+
+	size_t Host::MessageBudget(ENetPeer* peer) const
+	{
+		// replayed peers have no connection, they get the budget of a default one
+		size_t budget = host != nullptr ? DatagramBudget(peer) : ENET_HOST_DEFAULT_MTU - sizeof(ENetProtocolHeader) - sizeof(ENetProtocolSendFragment);
+		enet_uint8 header[10];
+		return budget - WriteVarint(header, budget);
+	}
+
+	void Host::QueueData(const void* data, size_t byteSize, ENetPeer* peer, Channel channel)
+	{
+		OutgoingQueue& queue = outgoing[peer];
+		enet_uint8 header[10];
+		size_t headerSize = WriteVarint(header, byteSize);
+
+		if (channel != Channel::State)
+		{
+			std::vector<enet_uint8>& run = channel == Channel::Bulk ? queue.bulk : queue.events;
+			run.insert(run.end(), header, header + headerSize);
+			run.insert(run.end(), (const enet_uint8*)data, (const enet_uint8*)data + byteSize);
+			return;
+		}
+
+		size_t budget = DatagramBudget(peer);
+		if (headerSize + byteSize > budget)
+		{
+			// too big to share a datagram, let ENet fragment it on its own
+			ENetPacket* packet = enet_packet_create(nullptr, headerSize + byteSize, ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+			memcpy(packet->data, header, headerSize);
+			memcpy(packet->data + headerSize, data, byteSize);
+			SendPacket(peer, Channel::State, packet);
+			return;
+		}
+
+		// start a new datagram if this message would overflow the current one
+		if (queue.state.size() + headerSize + byteSize > budget)
+			SendState(peer, queue);
+
+		queue.state.insert(queue.state.end(), header, header + headerSize);
+		queue.state.insert(queue.state.end(), (const enet_uint8*)data, (const enet_uint8*)data + byteSize);
+	}
+
+	void Host::QueueDataAlone(const void* data, size_t byteSize, ENetPeer* peer)
+	{
+		// the events queued before it go out first, reliable packets on a channel arrive in the order they were sent
+		OutgoingQueue& queue = outgoing[peer];
+		SendEvents(peer, queue);
+
+		enet_uint8 header[10];
+		size_t headerSize = WriteVarint(header, byteSize);
+		ENetPacket* packet = enet_packet_create(nullptr, headerSize + byteSize, ENET_PACKET_FLAG_RELIABLE);
+		memcpy(packet->data, header, headerSize);
+		memcpy(packet->data + headerSize, data, byteSize);
+		SendPacket(peer, Channel::Events, packet);
+	}
+
+	void Host::SendEvents(ENetPeer* peer, OutgoingQueue& queue)
+	{
+		if (queue.events.empty())
+			return;
+
+		ENetPacket* packet = enet_packet_create(queue.events.data(), queue.events.size(), ENET_PACKET_FLAG_RELIABLE);
+		SendPacket(peer, Channel::Events, packet);
+		queue.events.clear();
+	}
+
+	void Host::SendState(ENetPeer* peer, OutgoingQueue& queue)
+	{
+		if (queue.state.empty())
+			return;
+
+		ENetPacket* packet = enet_packet_create(queue.state.data(), queue.state.size(), ENET_PACKET_FLAG_UNSEQUENCED);
+		SendPacket(peer, Channel::State, packet);
+		queue.state.clear();
+	}
+
+	void Host::SendBulk(ENetPeer* peer, OutgoingQueue& queue)
+	{
+		// whole messages up to the budget, at least one so a message larger than the budget still goes out
+		size_t end = 0;
+		while (end < queue.bulk.size())
+		{
+			size_t offset = end;
+			size_t messageSize;
+			ReadVarint(queue.bulk.data(), queue.bulk.size(), offset, messageSize);
+			if (end > 0 && offset + messageSize > bulkBudget)
+				break;
+			end = offset + messageSize;
+		}
+
+		if (end == 0)
+			return;
+
+		ENetPacket* packet = enet_packet_create(queue.bulk.data(), end, ENET_PACKET_FLAG_RELIABLE);
+		SendPacket(peer, Channel::Bulk, packet);
+		queue.bulk.erase(queue.bulk.begin(), queue.bulk.begin() + end);
+	}
+
+	void Host::SendPacket(ENetPeer* peer, Channel channel, ENetPacket* packet)
+	{
+		size_t dataSize = packet->dataLength;
+
+		// a peer that opened fewer channels gets everything on the first one
+		enet_uint8 channelID = (enet_uint8)channel < peer->channelCount ? (enet_uint8)channel : 0;
+
+		// enet_peer_send only takes ownership of the packet if it succeeds
+		if (enet_peer_send(peer, channelID, packet) != 0)
+		{
+			enet_packet_destroy(packet);
+			return;
+		}
+
+		NetStats::PeerStats& peerStats = wireStats[peer];
+		peerStats.packetsOut++;
+		peerStats.bytesOut += dataSize;
+	}
+
+	void Host::CountPacketIn(ENetPeer* peer, size_t dataSize)
+	{
+		NetStats::PeerStats& peerStats = wireStats[peer];
+		peerStats.packetsIn++;
+		peerStats.bytesIn += dataSize;
+	}
+
+	void Host::SampleWireStats()
+	{
+		lastWireSample = enet_time_get();
+		for (auto& [peer, peerStats] : wireStats)
+		{
+			peerStats.roundTripTime = peer->roundTripTime;
+			peerStats.roundTripTimeVariance = peer->roundTripTimeVariance;
+			peerStats.packetLoss = (float)peer->packetLoss / (float)ENET_PEER_PACKET_LOSS_SCALE;
+		}
+	}
+
+	void Host::Flush()
+	{
+		if (host == nullptr)
+			return;
+
+		if (IsThreaded())
+			PushOutbound(NetEvent::Type::Flush, nullptr, nullptr, 0, Channel::Events);
+		else
+			FlushQueues();
+	}
+
+	void Host::FlushQueues()
+	{
+		for (auto it = outgoing.begin(); it != outgoing.end();)
+		{
+			ENetPeer* peer = it->first;
+			OutgoingQueue& queue = it->second;
+
+			// messages queued by the game thread before it saw the peer disconnect
+			if (peer->state != ENET_PEER_STATE_CONNECTED)
+			{
+				it = outgoing.erase(it);
+				continue;
+			}
+
+			SendEvents(peer, queue);
+			SendState(peer, queue);
+			SendBulk(peer, queue);
+			++it;
+		}
+
 		enet_host_flush(host);
 	}
 
+	bool Host::SetCompression(Compression compression, const char* dictionaryPath)
+	{
+		if (host == nullptr)
+		{
+			printf("\n[ERROR] tried to set the compression before the host was created.\n");
+			return false;
+		}
+
+		switch (compression)
+		{
+		case Compression::RangeCoder:
+			return enet_host_compress_with_range_coder(host) == 0;
+		case Compression::Dictionary:
+		{
+			NetDictionary dictionary;
+			if (dictionaryPath == nullptr || !dictionary.Load(dictionaryPath))
+				return false;
+
+			ENetCompressor compressor = DictionaryCompressor::Create(dictionary);
+			enet_host_compress(host, &compressor);
+			return true;
+		}
+		default:
+			enet_host_compress(host, nullptr);
+			return true;
+		}
+	}
+
+	bool Host::StartRecording(const char* path)
+	{
+		return recorder.Open(path);
+	}
+
+	void Host::StopRecording()
+	{
+		recorder.Close();
+	}
+
+	bool Host::StartReplay(const char* path, bool realTime)
+	{
+		if (host != nullptr)
+		{
+			printf("\n[ERROR] tried to replay a traffic log on a host that is already created.\n");
+			return false;
+		}
+
+		if (!playback.Open(path))
+			return false;
+
+		replayRealTime = realTime;
+		replayPending = false;
+		replayStart = enet_time_get();
+		replayPeers.clear();
+		return true;
+	}
+
+	bool Host::IsReplaying() const
+	{
+		return playback.IsOpen();
+	}
+
+	void Host::UpdateReplay()
+	{
+		enet_uint32 elapsed = enet_time_get() - replayStart;
+		while (true)
+		{
+			if (!replayPending)
+			{
+				if (!playback.Next(replayRecord, replayData))
+				{
+					printf("\n[INFO] replay finished.\n");
+					playback.Close();
+					return;
+				}
+				replayPending = true;
+			}
+
+			// in real time everything recorded up to now is handed out, otherwise one recorded Update per Update
+			if (replayRealTime && replayRecord.time > elapsed)
+				return;
+			replayPending = false;
+
+			ENetPeer* peer = &replayPeers[replayRecord.peer];
+			peer->incomingPeerID = replayRecord.peer;
+			switch (replayRecord.type)
+			{
+			case NetRecord::Type::Update:
+				if (!replayRealTime)
+					return;
+				break;
+			case NetRecord::Type::Connect:
+				peer->state = ENET_PEER_STATE_CONNECTED;
+				OnConnect(peer);
+				break;
+			case NetRecord::Type::Receive:
+				ReceivePacket(peer, replayData.data(), replayData.size());
+				break;
+			case NetRecord::Type::Disconnect:
+				OnDisconnect(peer);
+				peer->state = ENET_PEER_STATE_DISCONNECTED;
+				break;
+			default:
+				// what the recorded host sent, the replaying one answers on its own
+				break;
+			}
+		}
+	}
+
 #pragma endregion host
 
 #pragma region server
@@ -130,17 +740,23 @@ namespace Game
 	Server::~Server()
 	{}
 
-	bool Server::Init(const char* serverIP, enet_uint16 port, std::function<void(ENetPeer*)> _onClientConnect, std::function<void(ENetPeer*)> _onClientDisconnect)
+	bool Server::Init(const char* serverIP, enet_uint16 port, std::function<void(ENetPeer*)> _onClientConnect, std::function<void(ENetPeer*)> _onClientDisconnect,
+		size_t maxPeers, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
 	{
 		onClientConnect = _onClientConnect;
 		onClientDisconnect = _onClientDisconnect;
 
+		if (maxPeers == 0 || maxPeers > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+		{
+			printf("\n[ERROR] server capacity must be between 1 and %d peers.\n", ENET_PROTOCOL_MAXIMUM_PEER_ID);
+			return false;
+		}
 
 		ENetAddress address;
 		enet_address_set_host(&address, serverIP);
 		address.port = port;
 
-		host = enet_host_create(&address, 32, 2, 0, 0);
+		host = enet_host_create(&address, maxPeers, channelLimit, incomingBandwidth, outgoingBandwidth);
 
 		if (host == nullptr)
 		{
@@ -152,24 +768,25 @@ namespace Game
 		return true;
 	}
 
-	void Server::Broadcast(void* data, size_t byteSize, ENetPacketFlag packetFlag, ENetPeer* exlude)
+	bool Server::InitReplay(const char* path, bool realTime, std::function<void(ENetPeer*)> _onClientConnect, std::function<void(ENetPeer*)> _onClientDisconnect)
 	{
-		ENetPacket* packet = enet_packet_create(data, byteSize, packetFlag);
+		onClientConnect = _onClientConnect;
+		onClientDisconnect = _onClientDisconnect;
 
-		if (exlude == nullptr)
-		{
-			enet_host_broadcast(host, 0, packet);
-		}
-		else
+		if (!StartReplay(path, realTime))
+			return false;
+
+		printf("\n[INFO] replaying %s.\n", path);
+		return true;
+	}
+
+	void Server::Broadcast(void* data, size_t byteSize, Channel channel, ENetPeer* exlude)
+	{
+		for (auto& peer : connectedPeers)
 		{
-			for (auto& peer : connectedPeers)
-			{
-				if (peer != exlude)
-					enet_peer_send(peer, 0, packet);
-			}
+			if (peer != exlude)
+				SendData(data, byteSize, peer, channel);
 		}
-
-		enet_host_flush(host);
 	}
 
 	void Server::OnConnect(ENetPeer* peer)
@@ -194,7 +811,14 @@ namespace Game
 		Host(HostType::Client),
 		onServerConnect(nullptr),
 		onServerDisconnect(nullptr),
-		server(nullptr)
+		state(ConnectionState::Idle),
+		serverAddress({}),
+		connecting(nullptr),
+		stateStart(0),
+		retryDelay(0),
+		attempts(0),
+		server(nullptr),
+		reconnect(true)
 	{}
 
 	Client::~Client()
@@ -205,7 +829,13 @@ namespace Game
 		onServerConnect = _onServerConnect;
 		onServerDisconnect = _onServerDisconnect;
 
-		host = enet_host_create(nullptr, 1, 2, 0, 0);
+		Core::CVarCreate(Core::CVar_Int, "net_connect_timeout", "5000", "ms a connection attempt waits for the server before it is retried");
+		Core::CVarCreate(Core::CVar_Int, "net_resolve_timeout", "5000", "ms a host name lookup may take before the attempt is retried");
+		Core::CVarCreate(Core::CVar_Int, "net_connect_attempts", "5", "connection attempts before giving up, 0 keeps trying");
+		Core::CVarCreate(Core::CVar_Int, "net_retry_delay", "500", "ms before the first retry, about doubled by every further one");
+		Core::CVarCreate(Core::CVar_Int, "net_retry_max_delay", "8000", "longest ms between two connection attempts");
+
+		host = enet_host_create(nullptr, 1, (size_t)Channel::Count, 0, 0);
 
 		if (host == nullptr)
 		{
@@ -219,42 +849,161 @@ namespace Game
 
 	bool Client::TryConnecting(const char* serverIP, enet_uint16 port)
 	{
-		ENetAddress address;
-		ENetEvent event;
+		// ENet calls that are not from the service thread would race it
+		if (IsThreaded())
+		{
+			printf("\n[ERROR] cannot connect while the network thread runs.\n");
+			return false;
+		}
 
-		enet_address_set_host(&address, serverIP);
-		address.port = port;
+		if (state != ConnectionState::Idle)
+			return true;
+
+		serverHost = serverIP;
+		serverAddress.port = port;
+		attempts = 0;
+		retryDelay = (enet_uint32)std::max(Core::CVarReadInt(Core::CVarGet("net_retry_delay")), 1);
+		StartAttempt();
+		return true;
+	}
 
-		server = enet_host_connect(host, &address, 2, 0);
+	ConnectionState Client::GetState() const
+	{
+		return state;
+	}
+
+	void Client::StartAttempt()
+	{
+		attempts++;
+		stateStart = enet_time_get();
 
-		if (server == nullptr)
+		// addresses are used as they are, only host names have to be looked up
+		if (enet_address_set_host_ip(&serverAddress, serverHost.c_str()) == 0)
 		{
-			printf("\n[ERROR] failed to initiate ENet connection.\n");
-			return false;
+			Connect();
+			return;
 		}
-		if (enet_host_service(host, &event, 5000) > 0 &&
-			event.type == ENET_EVENT_TYPE_CONNECT)
+
+		// getaddrinfo blocks for as long as the name server takes, so it gets a thread of its own
+		state = ConnectionState::Resolving;
+		resolve = std::make_shared<Resolve>();
+		std::thread([lookup = resolve, name = serverHost]()
+		{
+			lookup->resolved = enet_address_set_host(&lookup->address, name.c_str()) == 0;
+			lookup->done.store(true, std::memory_order_release);
+		}).detach();
+	}
+
+	void Client::Connect()
+	{
+		connecting = enet_host_connect(host, &serverAddress, (size_t)Channel::Count, 0);
+		if (connecting == nullptr)
 		{
-			puts("Connection to serverIP succeeded.");
+			Retry("no free peer");
+			return;
 		}
-		else
+
+		state = ConnectionState::Connecting;
+		stateStart = enet_time_get();
+	}
+
+	void Client::Retry(const char* reason)
+	{
+		connecting = nullptr;
+		resolve = nullptr;
+
+		int maxAttempts = Core::CVarReadInt(Core::CVarGet("net_connect_attempts"));
+		if (maxAttempts > 0 && attempts >= maxAttempts)
 		{
-			enet_peer_reset(server);
-			puts("Connection to serverIP failed.");
+			printf("\n[ERROR] could not connect to %s:%u (%s), gave up after %d attempts.\n", serverHost.c_str(), serverAddress.port, reason, attempts);
+			state = ConnectionState::Idle;
+			return;
 		}
 
-		return true;
+		printf("\n[WARNING] connecting to %s:%u: %s, retrying in %u ms.\n", serverHost.c_str(), serverAddress.port, reason, retryDelay);
+		state = ConnectionState::Retrying;
+		stateStart = enet_time_get();
+	}
+
+	void Client::OnUpdate()
+	{
+		enet_uint32 elapsed = enet_time_get() - stateStart;
+		switch (state)
+		{
+		case ConnectionState::Resolving:
+			if (resolve->done.load(std::memory_order_acquire))
+			{
+				if (!resolve->resolved)
+				{
+					Retry("unknown host");
+					break;
+				}
+				enet_uint16 port = serverAddress.port;
+				serverAddress = resolve->address;
+				serverAddress.port = port;
+				resolve = nullptr;
+				Connect();
+			}
+			else if (elapsed >= (enet_uint32)Core::CVarReadInt(Core::CVarGet("net_resolve_timeout")))
+			{
+				Retry("lookup timed out");
+			}
+			break;
+		case ConnectionState::Connecting:
+			if (elapsed >= (enet_uint32)Core::CVarReadInt(Core::CVarGet("net_connect_timeout")))
+			{
+				enet_peer_reset(connecting);
+				Retry("timed out");
+			}
+			break;
+		case ConnectionState::Retrying:
+			if (elapsed >= retryDelay)
+			{
+				// the delay is spread a little, so clients that lost the same server do not all come back at once
+				enet_uint32 maxDelay = (enet_uint32)std::max(Core::CVarReadInt(Core::CVarGet("net_retry_max_delay")), 1);
+				retryDelay = std::min((enet_uint32)(retryDelay * (1.5f + Core::RandomFloat())), maxDelay);
+				StartAttempt();
+			}
+			break;
+		default:
+			break;
+		}
 	}
 
 	void Client::OnConnect(ENetPeer* peer)
 	{
+		if (peer != connecting)
+			return;
+
+		printf("\n[INFO] connected to %s:%u on attempt %d.\n", serverHost.c_str(), serverAddress.port, attempts);
+		server = peer;
+		connecting = nullptr;
+		state = ConnectionState::Connected;
 		onServerConnect(server);
 	}
 
 	void Client::OnDisconnect(ENetPeer* peer)
 	{
+		// the server refused the attempt or ENet gave up on it
+		if (peer == connecting)
+		{
+			Retry("refused");
+			return;
+		}
+
+		if (peer != server)
+			return;
+
 		onServerDisconnect(server);
 		server = nullptr;
+		state = ConnectionState::Idle;
+
+		if (reconnect)
+		{
+			attempts = 0;
+			retryDelay = (enet_uint32)std::max(Core::CVarReadInt(Core::CVarGet("net_retry_delay")), 1);
+			Retry("connection lost");
+		}
 	}
 }
 #pragma endregion client
\ No newline at end of file
@@ -1,10 +1,17 @@
 #pragma once
 #include "enet/enet.h"
 #include <vector>
-#include <memory>
 #include <unordered_set>
+#include <unordered_map>
 #include <functional>
+#include <thread>
+#include <atomic>
+#include <memory>
 #include "string"
+#include "core/ringbuffer.h"
+#include "netstats.h"
+#include "netrecorder.h"
+#include "compression.h"
 
 namespace Game
 {
@@ -13,13 +20,73 @@ namespace Game
 	struct PeerData
 	{
 		ENetPeer* sender;
-		std::shared_ptr<std::vector<enet_uint8>> data;
+		enet_uint8* data;		// owned by the host's receive pool, valid until the next PopDataStack/Update
+		size_t dataSize;
 
 		PeerData();
-		PeerData(ENetPeer* _sender, enet_uint8* _data, size_t dataSize);
-		PeerData(const PeerData& other);
-		PeerData& operator=(const PeerData& other);
-		~PeerData();
+		PeerData(ENetPeer* _sender, enet_uint8* _data, size_t _dataSize);
+	};
+
+	// Hands out fixed-size slabs for received payloads so the receive path does not hit the heap per packet.
+	// Payloads larger than a slab (fragmented reliable packets) get a dedicated allocation and count as misses.
+	class PacketPool
+	{
+	private:
+		std::vector<enet_uint8*> chunks;
+		std::vector<enet_uint8*> freeSlabs;
+		size_t slabsPerChunk;
+
+		void Grow();
+
+	public:
+		const size_t slabSize;
+		size_t hits;
+		size_t misses;
+
+		PacketPool(size_t _slabSize, size_t _slabsPerChunk);
+		~PacketPool();
+
+		enet_uint8* Acquire(size_t byteSize);
+		void Release(enet_uint8* block, size_t byteSize);
+	};
+
+	// ENet channels. Every channel is sequenced on its own, so a lost reliable message only holds up its own kind of traffic.
+	enum class Channel : enet_uint8
+	{
+		Events,		// reliable and ordered: connects, spawns, despawns, teleports
+		State,		// unsequenced: snapshots and inputs, a newer one makes up for a lost one
+		Bulk,		// reliable and ordered, sent last and at most bulkBudget bytes per flush: chat, large transfers
+		Count
+	};
+
+	// Messages queued for one peer during a tick, one run per channel. Every ENet packet carries a run of
+	// length-prefixed messages, small state messages are packed up to the peer's MTU.
+	struct OutgoingQueue
+	{
+		std::vector<enet_uint8> events;
+		std::vector<enet_uint8> state;
+		std::vector<enet_uint8> bulk;
+	};
+
+	// Event or command handed between the game thread and the service thread.
+	// The payload vector keeps its capacity when the ring slot is reused.
+	struct NetEvent
+	{
+		enum class Type
+		{
+			Connect,
+			Disconnect,
+			Receive,
+			Send,
+			SendAlone,
+			Flush,
+			Stats
+		};
+
+		Type type = Type::Flush;
+		ENetPeer* peer = nullptr;
+		Channel channel = Channel::Events;
+		std::vector<enet_uint8> data;
 	};
 
 	enum class HostType
@@ -33,19 +100,85 @@ namespace Game
 	protected:
 		ENetHost* host;
 		std::vector<PeerData> dataStack;
+		size_t dataStackRead;
+		PeerData poppedData;
+		std::unordered_map<ENetPeer*, OutgoingQueue> outgoing;
+
+		// only used while the service thread runs, all ENet calls then happen on that thread
+		std::thread serviceThread;
+		std::atomic<bool> serviceRunning;
+		Util::SpscRing<NetEvent> inbound;
+		Util::SpscRing<NetEvent> outbound;
+
+		// packet level counters, owned by whichever thread services ENet and copied into stats
+		std::unordered_map<ENetPeer*, NetStats::PeerStats> wireStats;
+		enet_uint32 lastWireSample;
+
+		// traffic log written on the game thread, and the log a replaying host takes its events from instead of ENet.
+		// replayed peers are stand-ins that only carry their id, whatever is sent to them is dropped
+		NetRecorder recorder;
+		NetPlayback playback;
+		bool replayRealTime;
+		bool replayPending;
+		enet_uint32 replayStart;
+		NetRecord replayRecord;
+		std::vector<enet_uint8> replayData;
+		std::unordered_map<enet_uint16, ENetPeer> replayPeers;
+
+		void ServiceLoop();
+		void PushInbound(NetEvent::Type type, ENetPeer* peer, const enet_uint8* data, size_t dataSize, Channel channel);
+		void PushOutbound(NetEvent::Type type, ENetPeer* peer, const void* data, size_t byteSize, Channel channel);
+		void FlushQueues();
+		void ReceivePacket(ENetPeer* sender, const enet_uint8* data, size_t dataSize);
+		void QueueData(const void* data, size_t byteSize, ENetPeer* peer, Channel channel);
+		void QueueDataAlone(const void* data, size_t byteSize, ENetPeer* peer);
+		void SendEvents(ENetPeer* peer, OutgoingQueue& queue);
+		void SendState(ENetPeer* peer, OutgoingQueue& queue);
+		void SendBulk(ENetPeer* peer, OutgoingQueue& queue);
+		void SendPacket(ENetPeer* peer, Channel channel, ENetPacket* packet);
+		void CountPacketIn(ENetPeer* peer, size_t dataSize);
+		void SampleWireStats();
+		bool StartReplay(const char* path, bool realTime);
+		void UpdateReplay();
 		virtual void OnConnect(ENetPeer* peer) = 0;
 		virtual void OnDisconnect(ENetPeer* peer) = 0;
+		// called by Update before it services ENet
+		virtual void OnUpdate() {}
 
 	public:
 		HostType type;
+		PacketPool receivePool;
+		NetStats stats;
+		size_t bulkBudget;		// bytes of bulk messages sent to a peer per flush, the rest waits for the next one
 
 		Host(HostType _type);
 		~Host();
 
+		// Moves enet_host_service onto its own thread. Update then only drains what that thread received,
+		// SendData/Flush hand messages over to it. Must be called after Init.
+		bool StartServiceThread();
+		void StopServiceThread();
+		bool IsThreaded() const;
+
 		void Update();
 		bool PopDataStack(PeerData& outData);
-		void SendData(void* data, size_t byteSize, ENetPeer* peer, ENetPacketFlag packetFlag);
-		
+		void SendData(void* data, size_t byteSize, ENetPeer* peer, Channel channel);
+		// Sends a reliable message on the Events channel in a packet of its own, behind the events sent before it.
+		// Up to MessageBudget bytes it goes out as a single datagram instead of fragmenting with the rest of the run.
+		void SendDataAlone(void* data, size_t byteSize, ENetPeer* peer);
+		// largest message that fits in one datagram to the peer, length prefix included
+		size_t MessageBudget(ENetPeer* peer) const;
+		void Flush();
+
+		// Compresses every datagram, the peers on the other end need the same setting. Must be called after Init
+		// and before connecting or starting the service thread.
+		bool SetCompression(Compression compression, const char* dictionaryPath = nullptr);
+
+		// Logs every event Update hands to the application and every message sent, see NetRecorder.
+		bool StartRecording(const char* path);
+		void StopRecording();
+		bool IsReplaying() const;
+
 	};
 
 	class Server : public Host
@@ -62,27 +195,67 @@ namespace Game
 		Server();
 		~Server();
 
-		bool Init(const char* serverIP, enet_uint16 port, std::function<void(ENetPeer*)> _onClientConnect, std::function<void(ENetPeer*)> _onClientDisconnect);
-		void Broadcast(void* data, size_t byteSize, ENetPacketFlag packetFlag, ENetPeer* exlude = nullptr);
+		// bandwidths are in bytes per second, 0 leaves ENet's throttling unlimited
+		bool Init(const char* serverIP, enet_uint16 port, std::function<void(ENetPeer*)> _onClientConnect, std::function<void(ENetPeer*)> _onClientDisconnect,
+			size_t maxPeers = 32, size_t channelLimit = 2, enet_uint32 incomingBandwidth = 0, enet_uint32 outgoingBandwidth = 0);
+		// Plays a traffic log recorded by a server to the callbacks instead of opening a socket. realTime keeps the
+		// recorded pace, otherwise every Update hands out the events of one recorded Update.
+		bool InitReplay(const char* path, bool realTime, std::function<void(ENetPeer*)> _onClientConnect, std::function<void(ENetPeer*)> _onClientDisconnect);
+		void Broadcast(void* data, size_t byteSize, Channel channel, ENetPeer* exlude = nullptr);
 		
 	};
 
+	// Where a Client's connection stands, Update moves it along
+	enum class ConnectionState
+	{
+		Idle,			// not connected and not trying to
+		Resolving,		// looking up the server's host name
+		Connecting,		// waiting for the server to answer
+		Connected,
+		Retrying		// waiting out the backoff before the next attempt
+	};
+
 	class Client : public Host
 	{
 	private:
+		// host name lookup running on its own thread, a lookup that timed out is left to finish on its own
+		struct Resolve
+		{
+			std::atomic<bool> done{ false };
+			bool resolved = false;
+			ENetAddress address = {};
+		};
+
 		std::function<void(ENetPeer*)> onServerConnect;
 		std::function<void(ENetPeer*)> onServerDisconnect;
+		ConnectionState state;
+		std::string serverHost;
+		ENetAddress serverAddress;
+		std::shared_ptr<Resolve> resolve;
+		ENetPeer* connecting;			// peer of the attempt in flight, server is only set once it is connected
+		enet_uint32 stateStart;			// ms
+		enet_uint32 retryDelay;			// ms until the next attempt, about doubled by every failed one
+		int attempts;
+
 		virtual void OnConnect(ENetPeer* peer) override;
 		virtual void OnDisconnect(ENetPeer* peer) override;
+		virtual void OnUpdate() override;
+		void StartAttempt();
+		void Connect();
+		void Retry(const char* reason);
 
 	public:
 		ENetPeer* server;
+		bool reconnect;		// connect again after the connection to the server was lost
 
 		Client();
 		~Client();
 
 		bool Init(std::function<void(ENetPeer*)> _onServerConnect, std::function<void(ENetPeer*)> _onServerDisconnect);
+		// Starts connecting without waiting for the server, Update drives the attempts and retries them with a growing
+		// backoff, see the net_connect_* cvars. Fails only if the connection can not be started at all.
 		bool TryConnecting(const char* serverIP, enet_uint16 port);
+		ConnectionState GetState() const;
 		
 	};
 }
\ No newline at end of file
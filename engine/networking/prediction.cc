@@ -0,0 +1,71 @@
+#include "config.h"
+#include "prediction.h"
+
+namespace Game
+{
+	Prediction::Prediction() :
+		first(0),
+		count(0)
+	{}
+
+	void Prediction::Predict(SpaceShip& spaceShip, const Input& input, float deltaTime)
+	{
+		// without acknowledgements for this long the oldest input is given up on
+		if (count == capacity)
+		{
+			first = (first + 1) % capacity;
+			count--;
+		}
+
+		spaceShip.inputData = input;
+		spaceShip.Simulate(deltaTime);
+		spaceShip.UpdateThrusters();
+
+		steps[(first + count) % capacity] = { input, deltaTime,
+			spaceShip.currentSpeed, spaceShip.rotXSmooth, spaceShip.rotYSmooth, spaceShip.rotZSmooth };
+		count++;
+	}
+
+	void Prediction::Reconcile(SpaceShip& spaceShip, const glm::vec3& serverPos, const glm::vec3& serverVel, const glm::quat& serverOri, uint64 inputAck)
+	{
+		while (count > 0 && steps[first].input.timeStamp <= inputAck)
+		{
+			const Step& acked = steps[first];
+			spaceShip.currentSpeed = acked.currentSpeed;
+			spaceShip.rotXSmooth = acked.rotXSmooth;
+			spaceShip.rotYSmooth = acked.rotYSmooth;
+			spaceShip.rotZSmooth = acked.rotZSmooth;
+
+			first = (first + 1) % capacity;
+			count--;
+		}
+
+		spaceShip.position = serverPos;
+		spaceShip.linearVelocity = serverVel;
+		spaceShip.direction = serverOri;
+		spaceShip.transform = glm::translate(serverPos) * (glm::mat4)serverOri;
+
+		for (uint32 i = 0; i < count; i++)
+		{
+			Step& step = steps[(first + i) % capacity];
+			spaceShip.inputData = step.input;
+			spaceShip.Simulate(step.deltaTime);
+			step.currentSpeed = spaceShip.currentSpeed;
+			step.rotXSmooth = spaceShip.rotXSmooth;
+			step.rotYSmooth = spaceShip.rotYSmooth;
+			step.rotZSmooth = spaceShip.rotZSmooth;
+		}
+		spaceShip.UpdateThrusters();
+	}
+
+	void Prediction::Clear()
+	{
+		first = 0;
+		count = 0;
+	}
+
+	uint32 Prediction::Pending() const
+	{
+		return count;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "spaceship.h"
+
+namespace Game
+{
+	// Client side prediction of the controlled ship. Every frame's input is applied locally right away and kept
+	// until the server acknowledges it. An authoritative state resets the ship and replays the inputs it has not seen yet.
+	class Prediction
+	{
+	public:
+		static constexpr uint32 capacity = 256;
+
+		struct Step
+		{
+			Input input;
+			float deltaTime;
+
+			// smoothing state after the step, it is not on the wire and is restored from the acknowledged step
+			float currentSpeed;
+			float rotXSmooth;
+			float rotYSmooth;
+			float rotZSmooth;
+		};
+
+		Prediction();
+
+		void Predict(SpaceShip& spaceShip, const Input& input, float deltaTime);
+		// inputAck is the timestamp of the newest input the server had applied when it sent the state
+		void Reconcile(SpaceShip& spaceShip, const glm::vec3& serverPos, const glm::vec3& serverVel, const glm::quat& serverOri, uint64 inputAck);
+		void Clear();
+		uint32 Pending() const;
+
+	private:
+		Step steps[capacity];
+		uint32 first;
+		uint32 count;
+	};
+}
@@ -0,0 +1,107 @@
+#include "config.h"
+#include "quantize.h"
+
+namespace Game
+{
+	static const float SmallestThreeMax = 0.70710678f; // 1/sqrt(2), no component besides the largest can exceed it
+
+	uint32 QuantizeFloat(float value, float min, float max, uint32 bits)
+	{
+		uint32 steps = (1u << bits) - 1;
+		float normalized = (glm::clamp(value, min, max) - min) / (max - min);
+		return (uint32)(normalized * (float)steps + 0.5f);
+	}
+
+	float DequantizeFloat(uint32 value, float min, float max, uint32 bits)
+	{
+		uint32 steps = (1u << bits) - 1;
+		return min + (float)value / (float)steps * (max - min);
+	}
+
+	void QuantizePosition(const glm::vec3& position, uint16& x, uint16& y, uint16& z)
+	{
+		x = (uint16)QuantizeFloat(position.x, -WorldExtent, WorldExtent, 16);
+		y = (uint16)QuantizeFloat(position.y, -WorldExtent, WorldExtent, 16);
+		z = (uint16)QuantizeFloat(position.z, -WorldExtent, WorldExtent, 16);
+	}
+
+	glm::vec3 DequantizePosition(uint16 x, uint16 y, uint16 z)
+	{
+		return glm::vec3(
+			DequantizeFloat(x, -WorldExtent, WorldExtent, 16),
+			DequantizeFloat(y, -WorldExtent, WorldExtent, 16),
+			DequantizeFloat(z, -WorldExtent, WorldExtent, 16)
+		);
+	}
+
+	uint32 QuantizeVelocity(const glm::vec3& velocity, float maxSpeed)
+	{
+		return QuantizeFloat(velocity.x, -maxSpeed, maxSpeed, 10) |
+			(QuantizeFloat(velocity.y, -maxSpeed, maxSpeed, 10) << 10) |
+			(QuantizeFloat(velocity.z, -maxSpeed, maxSpeed, 10) << 20);
+	}
+
+	glm::vec3 DequantizeVelocity(uint32 packed, float maxSpeed)
+	{
+		glm::vec3 velocity = glm::vec3(
+			DequantizeFloat(packed & 0x3FF, -maxSpeed, maxSpeed, 10),
+			DequantizeFloat((packed >> 10) & 0x3FF, -maxSpeed, maxSpeed, 10),
+			DequantizeFloat((packed >> 20) & 0x3FF, -maxSpeed, maxSpeed, 10)
+		);
+
+		// the odd step count has no exact zero, snap so idle ships don't drift
+		const float epsilon = maxSpeed / 1000.f;
+		for (int i = 0; i < 3; i++)
+			if (glm::abs(velocity[i]) < epsilon)
+				velocity[i] = 0.f;
+
+		return velocity;
+	}
+
+	uint32 QuantizeOrientation(const glm::quat& orientation)
+	{
+		glm::quat q = glm::normalize(orientation);
+		float components[4] = { q.x, q.y, q.z, q.w };
+
+		uint32 largest = 0;
+		for (uint32 i = 1; i < 4; i++)
+			if (glm::abs(components[i]) > glm::abs(components[largest]))
+				largest = i;
+
+		// q and -q are the same rotation, flip so the dropped component is positive
+		float sign = components[largest] < 0.f ? -1.f : 1.f;
+
+		uint32 packed = largest << 30;
+		uint32 shift = 20;
+		for (uint32 i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+
+			packed |= QuantizeFloat(components[i] * sign, -SmallestThreeMax, SmallestThreeMax, 10) << shift;
+			shift -= 10;
+		}
+
+		return packed;
+	}
+
+	glm::quat DequantizeOrientation(uint32 packed)
+	{
+		uint32 largest = packed >> 30;
+		float components[4];
+		float sumSquared = 0.f;
+		uint32 shift = 20;
+		for (uint32 i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+
+			components[i] = DequantizeFloat((packed >> shift) & 0x3FF, -SmallestThreeMax, SmallestThreeMax, 10);
+			sumSquared += components[i] * components[i];
+			shift -= 10;
+		}
+		components[largest] = glm::sqrt(glm::max(0.f, 1.f - sumSquared));
+
+		return glm::normalize(glm::quat(components[3], components[0], components[1], components[2]));
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "glm.hpp"
+
+namespace Game
+{
+	// Positions on the wire are quantized to 16 bits per axis within +-WorldExtent, about 1.6cm precision.
+	const float WorldExtent = 512.f;
+
+	uint32 QuantizeFloat(float value, float min, float max, uint32 bits);
+	float DequantizeFloat(uint32 value, float min, float max, uint32 bits);
+
+	void QuantizePosition(const glm::vec3& position, uint16& x, uint16& y, uint16& z);
+	glm::vec3 DequantizePosition(uint16 x, uint16 y, uint16 z);
+
+	// 10 bits per axis within +-maxSpeed, packed into the low 30 bits
+	uint32 QuantizeVelocity(const glm::vec3& velocity, float maxSpeed);
+	glm::vec3 DequantizeVelocity(uint32 packed, float maxSpeed);
+
+	// smallest three: index of the dropped largest component in the top 2 bits, the others with 10 bits each
+	uint32 QuantizeOrientation(const glm::quat& orientation);
+	glm::quat DequantizeOrientation(uint32 packed);
+}
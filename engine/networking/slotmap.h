@@ -0,0 +1,149 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace Game
+{
+	// Entities by network uuid. Values are kept densely for the update and draw loops, removing one moves the last
+	// value into its place. A Handle names a slot and the generation it was issued in, so one that is kept past
+	// the removal of its entity no longer resolves, even once the slot is reused.
+	template<typename T>
+	class SlotMap
+	{
+	public:
+		struct Handle
+		{
+			uint32 slot = UINT32_MAX;
+			uint32 generation = 0;
+		};
+
+		// Replaces the value if the uuid is already present.
+		Handle Insert(uint32 uuid, const T& value)
+		{
+			auto found = index.find(uuid);
+			if (found != index.end())
+			{
+				values[slots[found->second].dense] = value;
+				return { found->second, slots[found->second].generation };
+			}
+
+			uint32 slot;
+			if (freeSlots.empty())
+			{
+				slot = (uint32)slots.size();
+				slots.push_back({ 0, 0 });
+			}
+			else
+			{
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+			}
+
+			slots[slot].dense = (uint32)values.size();
+			values.push_back(value);
+			uuids.push_back(uuid);
+			denseSlots.push_back(slot);
+			index[uuid] = slot;
+			return { slot, slots[slot].generation };
+		}
+
+		// nullptr if the uuid is not present
+		T* Find(uint32 uuid)
+		{
+			auto found = index.find(uuid);
+			return found != index.end() ? &values[slots[found->second].dense] : nullptr;
+		}
+
+		// nullptr if the entity the handle was issued for has been removed
+		T* Get(Handle handle)
+		{
+			if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation)
+				return nullptr;
+			return &values[slots[handle.slot].dense];
+		}
+
+		Handle HandleOf(uint32 uuid) const
+		{
+			auto found = index.find(uuid);
+			return found != index.end() ? Handle{ found->second, slots[found->second].generation } : Handle{};
+		}
+
+		bool Erase(uint32 uuid)
+		{
+			auto found = index.find(uuid);
+			if (found == index.end())
+				return false;
+
+			uint32 slot = found->second;
+			index.erase(found);
+			RemoveDense(slots[slot].dense);
+			slots[slot].generation++;
+			freeSlots.push_back(slot);
+			return true;
+		}
+
+		// Removes the value at a dense position, the last value takes its place.
+		void EraseAt(size_t position)
+		{
+			Erase(uuids[position]);
+		}
+
+		uint32 UuidAt(size_t position) const
+		{
+			return uuids[position];
+		}
+
+		void Clear()
+		{
+			// every handle issued so far goes stale
+			for (uint32 slot : denseSlots)
+			{
+				slots[slot].generation++;
+				freeSlots.push_back(slot);
+			}
+			values.clear();
+			uuids.clear();
+			denseSlots.clear();
+			index.clear();
+		}
+
+		size_t size() const { return values.size(); }
+		bool empty() const { return values.empty(); }
+		T& operator[](size_t position) { return values[position]; }
+		const T& operator[](size_t position) const { return values[position]; }
+		typename std::vector<T>::iterator begin() { return values.begin(); }
+		typename std::vector<T>::iterator end() { return values.end(); }
+		typename std::vector<T>::const_iterator begin() const { return values.begin(); }
+		typename std::vector<T>::const_iterator end() const { return values.end(); }
+
+	private:
+		struct Slot
+		{
+			uint32 dense;
+			uint32 generation;
+		};
+
+		void RemoveDense(uint32 dense)
+		{
+			uint32 last = (uint32)values.size() - 1;
+			if (dense != last)
+			{
+				values[dense] = std::move(values[last]);
+				uuids[dense] = uuids[last];
+				denseSlots[dense] = denseSlots[last];
+				slots[denseSlots[dense]].dense = dense;
+			}
+			values.pop_back();
+			uuids.pop_back();
+			denseSlots.pop_back();
+		}
+
+		std::vector<T> values;
+		std::vector<uint32> uuids;			// uuid of every value
+		std::vector<uint32> denseSlots;		// slot of every value
+		std::vector<Slot> slots;
+		std::vector<uint32> freeSlots;
+		std::unordered_map<uint32, uint32> index;	// uuid to slot
+	};
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace Game
+{
+	// Ring of recent world snapshots. Entity states are kept sorted by uuid so two snapshots can be
+	// diffed with a single merge walk. STATE is a plain wire struct exposing uuid().
+	template<typename STATE, uint32 SIZE = 32>
+	class SnapshotHistory
+	{
+	public:
+		struct Snapshot
+		{
+			uint32 sequence = 0;
+			std::vector<STATE> states;
+		};
+
+		// Returns the slot for a new snapshot, overwriting the oldest one.
+		Snapshot& Store(uint32 sequence)
+		{
+			Snapshot& snapshot = snapshots[sequence % SIZE];
+			snapshot.sequence = sequence;
+			snapshot.states.clear();
+			newest = std::max(newest, sequence);
+			return snapshot;
+		}
+
+		// Returns nullptr if the snapshot was never stored or has already been overwritten, judged by how far it is
+		// behind the newest stored one. The slot of the oldest one is the next to be overwritten, read it before Store.
+		const Snapshot* Find(uint32 sequence) const
+		{
+			if (sequence == 0 || sequence > newest || newest - sequence >= SIZE)
+				return nullptr;
+
+			const Snapshot& snapshot = snapshots[sequence % SIZE];
+			return snapshot.sequence == sequence ? &snapshot : nullptr;
+		}
+
+		void Clear()
+		{
+			for (Snapshot& snapshot : snapshots)
+			{
+				snapshot.sequence = 0;
+				snapshot.states.clear();
+			}
+			newest = 0;
+		}
+
+	private:
+		Snapshot snapshots[SIZE];
+		uint32 newest = 0;
+	};
+
+	// Collects the states in 'current' that are new or differ from 'baseline', and the uuids that only exist in 'baseline'.
+	template<typename STATE>
+	void DiffSnapshots(const std::vector<STATE>& baseline, const std::vector<STATE>& current, std::vector<STATE>& changed, std::vector<uint32>& removed)
+	{
+		changed.clear();
+		removed.clear();
+
+		size_t b = 0;
+		for (const STATE& state : current)
+		{
+			while (b < baseline.size() && baseline[b].uuid() < state.uuid())
+				removed.push_back(baseline[b++].uuid());
+
+			if (b < baseline.size() && baseline[b].uuid() == state.uuid())
+			{
+				if (memcmp(&baseline[b], &state, sizeof(STATE)) != 0)
+					changed.push_back(state);
+				b++;
+			}
+			else
+			{
+				changed.push_back(state);
+			}
+		}
+
+		for (; b < baseline.size(); b++)
+			removed.push_back(baseline[b].uuid());
+	}
+
+	// Rebuilds a full snapshot from 'baseline' and a delta produced by DiffSnapshots.
+	template<typename STATE>
+	void ApplySnapshotDelta(const std::vector<STATE>& baseline, const STATE* changed, size_t changedCount, const uint32* removed, size_t removedCount, std::vector<STATE>& out)
+	{
+		out.clear();
+
+		size_t c = 0, r = 0;
+		for (const STATE& state : baseline)
+		{
+			while (c < changedCount && changed[c].uuid() < state.uuid())
+				out.push_back(changed[c++]);
+
+			while (r < removedCount && removed[r] < state.uuid())
+				r++;
+
+			if (c < changedCount && changed[c].uuid() == state.uuid())
+				out.push_back(changed[c++]);
+			else if (r >= removedCount || removed[r] != state.uuid())
+				out.push_back(state);
+		}
+
+		for (; c < changedCount; c++)
+			out.push_back(changed[c]);
+	}
+}
@@ -1,15 +1,19 @@
 #include "config.h"
 #include "spaceship.h"
+#include "render/physics.h"
+#ifndef HEADLESS
 #include "render/input/inputserver.h"
 #include "render/cameramanager.h"
-#include "render/physics.h"
 #include "render/debugrender.h"
 #include "render/particlesystem.h"
+#endif
 #include <vector>
 
-using namespace Input;
 using namespace glm;
+#ifndef HEADLESS
+using namespace Input;
 using namespace Render;
+#endif
 
 namespace Game
 {
@@ -29,6 +33,7 @@ namespace Game
     SpaceShip::SpaceShip() :
         deadReck(0.2f) //200ms latency
     {
+#ifndef HEADLESS
         uint32_t numParticles = 2048;
         this->particleEmitterLeft = new ParticleEmitter(numParticles);
         this->particleEmitterLeft->data = {
@@ -53,12 +58,15 @@ namespace Game
 
         ParticleSystem::Instance()->AddEmitter(this->particleEmitterLeft);
         ParticleSystem::Instance()->AddEmitter(this->particleEmitterRight);
+#endif
     }
 
     SpaceShip::~SpaceShip()
     {
+#ifndef HEADLESS
         ParticleSystem::Instance()->RemoveEmitter(this->particleEmitterLeft);
         ParticleSystem::Instance()->RemoveEmitter(this->particleEmitterRight);
+#endif
     }
 
     bool SpaceShip::CheckCollisions()
@@ -78,7 +86,9 @@ namespace Game
 
             if (payload.hit)
             {
+#ifndef HEADLESS
                 Debug::DrawDebugText("HIT", payload.hitPoint, glm::vec4(1, 1, 1, 1));
+#endif
                 hit = true;
             }
         }
@@ -96,15 +106,23 @@ namespace Game
 
     void SpaceShip::SetThisCamera(float dt)
     {
+#ifndef HEADLESS
         Camera* cam = CameraManager::GetCamera(CAMERA_MAIN);
         // update camera view transform
         vec3 desiredCamPos = this->position + vec3(this->transform * vec4(0, this->camOffsetY, -4.0f, 0));
         this->camPos = mix(this->camPos, desiredCamPos, dt * this->cameraSmoothFactor);
 
         cam->view = lookAt(this->camPos, this->camPos + vec3(this->transform[2]), vec3(this->transform[1]));
+#endif
     }
 
     void SpaceShip::ServerUpdate(float dt)
+    {
+        this->Simulate(dt);
+        this->UpdateThrusters();
+    }
+
+    void SpaceShip::Simulate(float dt)
     {
         if (this->inputData.w)
         {
@@ -127,7 +145,7 @@ namespace Game
         float rotY = this->inputData.up ? -1.0f : this->inputData.down ? 1.0f : 0.0f;
         float rotZ = this->inputData.a ? -1.0f : this->inputData.d ? 1.0f : 0.0f;
 
-        this->position += this->linearVelocity * dt * 10.0f;
+        this->position += this->linearVelocity * dt * DeadReck::velocityScale;
 
         const float rotationSpeed = 1.8f * dt;
         const float fixedDt = 1.f / 60.f;
@@ -142,31 +160,29 @@ namespace Game
         glm::mat4 T = translate(this->position) * (mat4)this->direction;
         this->transform = T;
         this->rotationZ = mix(this->rotationZ, 0.0f, cameraSmoothFactor * fixedDt);
-
-        const float thrusterPosOffset = 0.365f;
-        this->particleEmitterLeft->data.origin = glm::vec4(vec3(this->position + (vec3(this->transform[0]) * -thrusterPosOffset)) + (vec3(this->transform[2]) * emitterOffset), 1);
-        this->particleEmitterLeft->data.dir = glm::vec4(glm::vec3(-this->transform[2]), 0);
-        this->particleEmitterRight->data.origin = glm::vec4(vec3(this->position + (vec3(this->transform[0]) * thrusterPosOffset)) + (vec3(this->transform[2]) * emitterOffset), 1);
-        this->particleEmitterRight->data.dir = glm::vec4(glm::vec3(-this->transform[2]), 0);
-
-        float t = (this->currentSpeed / this->normalSpeed);
-        this->particleEmitterLeft->data.startSpeed = 1.2 + (3.0f * t);
-        this->particleEmitterLeft->data.endSpeed = 0.0f + (3.0f * t);
-        this->particleEmitterRight->data.startSpeed = 1.2 + (3.0f * t);
-        this->particleEmitterRight->data.endSpeed = 0.0f + (3.0f * t);
     }
 
-    void SpaceShip::ClientUpdate(float dt)
+    void SpaceShip::ClientUpdate(float dt, uint64 serverNow)
     {
-        DeadReck::Body interpBody = this->deadReck.Interpolate(dt);
-        this->position = interpBody.position;
-        this->linearVelocity = interpBody.velocity;
-        this->direction = interpBody.orientation;
+        DeadReck::Body interpBody = this->deadReck.Interpolate(dt, serverNow);
+        this->ClientApply(interpBody, translate(interpBody.position) * (mat4)interpBody.orientation);
+    }
 
-        this->transform = translate(this->position) * (mat4)this->direction;
+    void SpaceShip::ClientApply(const DeadReck::Body& body, const glm::mat4& transform)
+    {
+        this->position = body.position;
+        this->linearVelocity = body.velocity;
+        this->direction = body.orientation;
+        this->transform = transform;
 
         this->currentSpeed = glm::length(this->linearVelocity);
 
+        this->UpdateThrusters();
+    }
+
+    void SpaceShip::UpdateThrusters()
+    {
+#ifndef HEADLESS
         const float thrusterPosOffset = 0.365f;
         this->particleEmitterLeft->data.origin = glm::vec4(vec3(this->position + (vec3(this->transform[0]) * -thrusterPosOffset)) + (vec3(this->transform[2]) * emitterOffset), 1);
         this->particleEmitterLeft->data.dir = glm::vec4(glm::vec3(-this->transform[2]), 0);
@@ -178,10 +194,11 @@ namespace Game
         this->particleEmitterLeft->data.endSpeed = 0.0f + (3.0f * t);
         this->particleEmitterRight->data.startSpeed = 1.2 + (3.0f * t);
         this->particleEmitterRight->data.endSpeed = 0.0f + (3.0f * t);
+#endif
     }
 
-    void SpaceShip::SetServerData(const glm::vec3& serverPos, const glm::vec3& serverVel, const glm::vec3& serverAcc, const glm::quat& serverOri, bool hardReset, uint64 timeStamp)
+    void SpaceShip::SetServerData(const glm::vec3& serverPos, const glm::vec3& serverVel, const glm::vec3& serverAcc, const glm::quat& serverOri, bool hardReset, uint64 timeStamp, uint64 serverTime, uint64 arrivalTime)
     {
-        this->deadReck.SetServerData({ serverPos, serverVel, serverAcc, serverOri }, hardReset, timeStamp);
+        this->deadReck.SetServerData({ serverPos, serverVel, serverAcc, serverOri }, hardReset, timeStamp, serverTime, arrivalTime);
     }
 }
\ No newline at end of file
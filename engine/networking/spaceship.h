@@ -33,8 +33,8 @@ namespace Game
         glm::vec3 camPos = glm::vec3(0, 1.0f, -2.0f);
         glm::mat4 transform = glm::mat4(1);
 
-        const float normalSpeed = 1.0f;
-        const float boostSpeed = normalSpeed * 2.0f;
+        static constexpr float normalSpeed = 1.0f;
+        static constexpr float boostSpeed = normalSpeed * 2.0f;
         const float accelerationFactor = 1.0f;
         const float camOffsetY = 1.0f;
         const float cameraSmoothFactor = 10.0f;
@@ -46,8 +46,8 @@ namespace Game
         float rotYSmooth = 0;
         float rotZSmooth = 0;
 
-        Render::ParticleEmitter* particleEmitterLeft;
-        Render::ParticleEmitter* particleEmitterRight;
+        Render::ParticleEmitter* particleEmitterLeft = nullptr;
+        Render::ParticleEmitter* particleEmitterRight = nullptr;
         float emitterOffset = -0.5f;
 
         uint32 id = 0;
@@ -58,8 +58,14 @@ namespace Game
         void SetInputData(const Input& data);
         void SetThisCamera(float dt);
         void ServerUpdate(float dt);
-        void ClientUpdate(float dt);
-        void SetServerData(const glm::vec3& serverPos, const glm::vec3& serverVel, const glm::vec3& serverAcc, const glm::quat& serverOri, bool hardReset, uint64 timeStamp);
+        // movement from inputData, shared by the server and the client's prediction of its own ship
+        void Simulate(float dt);
+        // serverNow is the server's time as estimated by the client
+        void ClientUpdate(float dt, uint64 serverNow);
+        // the rest of ClientUpdate, for ships whose interpolation was run in an InterpolationBatch
+        void ClientApply(const DeadReck::Body& body, const glm::mat4& transform);
+        void UpdateThrusters();
+        void SetServerData(const glm::vec3& serverPos, const glm::vec3& serverVel, const glm::vec3& serverAcc, const glm::quat& serverOri, bool hardReset, uint64 timeStamp, uint64 serverTime, uint64 arrivalTime);
 
         const glm::vec3 colliderEndPoints[8] = {
             glm::vec3(-1.10657, -0.480347, -0.346542),  // right wing
@@ -0,0 +1,73 @@
+#include "config.h"
+#include "spatialgrid.h"
+
+namespace Game
+{
+	SpatialGrid::SpatialGrid(float _cellSize) :
+		cellSize(_cellSize)
+	{}
+
+	SpatialGrid::~SpatialGrid() {}
+
+	uint64 SpatialGrid::CellKey(int32 x, int32 y, int32 z) const
+	{
+		// 21 bits per axis is plenty for any cell size we use
+		const uint64 mask = 0x1FFFFF;
+		return ((uint64)x & mask) | (((uint64)y & mask) << 21) | (((uint64)z & mask) << 42);
+	}
+
+	int32 SpatialGrid::CellCoord(float value) const
+	{
+		return (int32)glm::floor(value / cellSize);
+	}
+
+	void SpatialGrid::Clear()
+	{
+		for (auto it = cells.begin(); it != cells.end();)
+		{
+			// drop cells that stayed empty for a whole rebuild, keep the others' storage
+			if (it->second.empty())
+			{
+				it = cells.erase(it);
+			}
+			else
+			{
+				it->second.clear();
+				++it;
+			}
+		}
+	}
+
+	void SpatialGrid::Insert(uint32 index, const glm::vec3& position)
+	{
+		uint64 key = CellKey(CellCoord(position.x), CellCoord(position.y), CellCoord(position.z));
+		cells[key].push_back({ index, position });
+	}
+
+	void SpatialGrid::Query(const glm::vec3& center, float radius, std::vector<uint32>& out) const
+	{
+		glm::ivec3 minCell(CellCoord(center.x - radius), CellCoord(center.y - radius), CellCoord(center.z - radius));
+		glm::ivec3 maxCell(CellCoord(center.x + radius), CellCoord(center.y + radius), CellCoord(center.z + radius));
+		float radiusSquared = radius * radius;
+
+		for (int32 x = minCell.x; x <= maxCell.x; x++)
+		{
+			for (int32 y = minCell.y; y <= maxCell.y; y++)
+			{
+				for (int32 z = minCell.z; z <= maxCell.z; z++)
+				{
+					auto cell = cells.find(CellKey(x, y, z));
+					if (cell == cells.end())
+						continue;
+
+					for (const Entry& entry : cell->second)
+					{
+						glm::vec3 diff = entry.position - center;
+						if (glm::dot(diff, diff) <= radiusSquared)
+							out.push_back(entry.index);
+					}
+				}
+			}
+		}
+	}
+}
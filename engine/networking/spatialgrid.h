@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+
+namespace Game
+{
+	// Uniform grid used for interest management. Cells are hashed, so the world has no fixed
+	// bounds, and their storage is kept between rebuilds so a rebuild per tick does not allocate.
+	class SpatialGrid
+	{
+	private:
+		struct Entry
+		{
+			uint32 index;
+			glm::vec3 position;
+		};
+
+		float cellSize;
+		std::unordered_map<uint64, std::vector<Entry>> cells;
+
+		uint64 CellKey(int32 x, int32 y, int32 z) const;
+		int32 CellCoord(float value) const;
+
+	public:
+		SpatialGrid(float _cellSize);
+		~SpatialGrid();
+
+		void Clear();
+		void Insert(uint32 index, const glm::vec3& position);
+		// appends the index of every entry within radius of center to out
+		void Query(const glm::vec3& center, float radius, std::vector<uint32>& out) const;
+	};
+}
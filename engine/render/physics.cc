@@ -6,7 +6,9 @@
 #include "physics.h"
 #include "core/idpool.h"
 #include "render/gltf.h"
+#ifndef HEADLESS
 #include "debugrender.h"
+#endif
 #include "core/random.h"
 #include "core/cvar.h"
 #include <iostream>
@@ -255,6 +257,7 @@ void SetupBVH()
 
 void DrawBVH(BVHNode* node, int depth, int maxDepth)
 {
+#ifndef HEADLESS
     if (depth == maxDepth) return;
 
     glm::vec3 center = (node->bbox.max + node->bbox.min) / 2.0f;
@@ -269,10 +272,12 @@ void DrawBVH(BVHNode* node, int depth, int maxDepth)
         DrawBVH(bvh->nodes + node->index, depth + 1, maxDepth);
         DrawBVH(bvh->nodes + node->index + 1, depth + 1, maxDepth);
     }
+#endif
 }
 
 void VisualizeBVH()
 {
+#ifndef HEADLESS
     Core::CVar* debug_bvh_mode = Core::CVarGet("debug_bvh_mode");
     Core::CVar* debug_bvh_maxdepth = Core::CVarGet("debug_bvh_maxdepth");
 
@@ -312,6 +317,7 @@ void VisualizeBVH()
             DrawBVH(bvh->nodes, 0, maxDepth);
         }
     }
+#endif
 }
 
 struct ColliderMesh
@@ -397,9 +403,9 @@ LoadFromIndexBuffer(fx::gltf::Document const& doc, ColliderMesh* mesh)
     mesh->bSphereRadius = vbAccessor.max[0];
     mesh->bSphereRadius = std::max(mesh->bSphereRadius, vbAccessor.max[1]);
     mesh->bSphereRadius = std::max(mesh->bSphereRadius, vbAccessor.max[2]);
-    mesh->bSphereRadius = std::max(mesh->bSphereRadius, fabs(vbAccessor.min[0]));
-    mesh->bSphereRadius = std::max(mesh->bSphereRadius, fabs(vbAccessor.min[1]));
-    mesh->bSphereRadius = std::max(mesh->bSphereRadius, fabs(vbAccessor.min[2]));
+    mesh->bSphereRadius = std::max(mesh->bSphereRadius, std::fabs(vbAccessor.min[0]));
+    mesh->bSphereRadius = std::max(mesh->bSphereRadius, std::fabs(vbAccessor.min[1]));
+    mesh->bSphereRadius = std::max(mesh->bSphereRadius, std::fabs(vbAccessor.min[2]));
 }
 
 
@@ -8,7 +8,42 @@
 #include "render/debugrender.h"
 #include "render/input/inputserver.h"
 #include "core/random.h"
+#include "core/cvar.h"
 #include <chrono>
+#include <algorithm>
+#include <cstring>
+
+// the wrapper's packet type names a message for the network stats
+static size_t PacketTypeOf(const enet_uint8* data, size_t dataSize)
+{
+    return (size_t)Protocol::GetPacketWrapper(data)->packet_type();
+}
+
+// lifecycle events are reliable and ordered, the state streams must not wait behind them and chat waits for both
+static Game::Channel ChannelFor(Protocol::PacketType type)
+{
+    switch (type)
+    {
+    case Protocol::PacketType_SnapshotS2C:
+    case Protocol::PacketType_UpdatePlayerS2C:
+    case Protocol::PacketType_InputC2S:
+    case Protocol::PacketType_ClockSyncC2S:
+    case Protocol::PacketType_ClockSyncS2C:
+        return Game::Channel::State;
+    case Protocol::PacketType_TextS2C:
+    case Protocol::PacketType_TextC2S:
+        return Game::Channel::Bulk;
+    default:
+        return Game::Channel::Events;
+    }
+}
+
+// the clock read fresh, the frame's currentTime is too coarse for clock sync timestamps
+static uint64 SystemTimeMillis()
+{
+    auto duration = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
 
 ClientApp::ClientApp() :
     window(nullptr),
@@ -16,9 +51,10 @@ ClientApp::ClientApp() :
     client(nullptr),
     currentTime(0),
     timeDiff(0),
+    lastClockSync(0),
+    lastSnapshot(0),
     hasReceivedSpaceShip(false),
     controlledShipId(0),
-    controlledShip(nullptr),
     spaceShipModel(0),
     laserModel(0),
     laserSpeed(0.f)
@@ -59,9 +95,19 @@ bool ClientApp::Open()
         return false;
     }
     atexit(enet_deinitialize);
+    Core::CVarCreate(Core::CVarType::CVar_Int, "net_compression", "0", "0 sends datagrams as they are, 1 with ENet's range coder, 2 with the net_dictionary compressor, server and clients must match");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "cl_interp", "1", "1 shows other ships from a buffer of server states at a delay that follows the jitter, 0 blends them towards the newest state over 200 ms");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "cl_interp_batch", "1", "1 interpolates the buffered ships together with SSE, 0 one by one through DeadReck::Interpolate");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "cl_clocksync", "500", "ms between clock sync requests to the server");
+    Core::CVarCreate(Core::CVarType::CVar_String, "net_dictionary", "net_dictionary.bin", "dictionary file for net_compression 2, trained with the server's dictionary command");
 
     // setup console commands
     this->console = new Game::Console("Client", 128, 128, 10);
+    this->console->SetPanel([this]()
+    {
+        if (this->client != nullptr)
+            this->client->stats.Draw();
+    });
     this->console->SetCommand("client", [this](const std::string& arg)
         {
         std::string argIP;
@@ -69,7 +115,7 @@ bool ClientApp::Open()
         Game::splitStringSpace(arg, argIP, argPort);
         if (this->client != nullptr)
         {
-            if(this->client->server == nullptr)
+            if (this->client->GetState() == Game::ConnectionState::Idle)
                 this->client->TryConnecting(argIP.c_str(), argPort);
 
             return;
@@ -86,7 +132,10 @@ bool ClientApp::Open()
         };
 
         this->client = new Game::Client();
+        this->client->stats.SetMessageTypes(Protocol::EnumNamesPacketType(), Protocol::PacketType_MAX + 1, PacketTypeOf);
+        Game::Compression compression = (Game::Compression)Core::CVarReadInt(Core::CVarGet("net_compression"));
         if (!this->client->Init(connected, disconnected) ||
+            !this->client->SetCompression(compression, Core::CVarReadString(Core::CVarGet("net_dictionary"))) ||
             !this->client->TryConnecting(argIP.c_str(), argPort))
         {
             delete this->client;
@@ -102,12 +151,11 @@ bool ClientApp::Open()
         if (this->client == nullptr || this->client->server == nullptr)
             return;
 
-        flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
+        flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
         auto outPacket = Protocol::CreateTextC2SDirect(builder, arg.c_str());
-        auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_TextC2S, outPacket.Union());
-        builder.Finish(packetWrapper);
+        this->FinishPacket(builder, Protocol::PacketType_TextC2S, outPacket.Union());
 
-        this->client->SendData(builder.GetBufferPointer(), builder.GetSize(), this->client->server, ENET_PACKET_FLAG_RELIABLE);
+        this->client->SendData(builder.GetBufferPointer(), builder.GetSize(), this->client->server, ChannelFor(Protocol::PacketType_TextC2S));
         this->console->AddOutput("[MESSAGE] you: " + arg);
     });
 
@@ -218,9 +266,7 @@ void ClientApp::Run()
     while (this->window->IsOpen())
     {
         auto timeStart = std::chrono::steady_clock::now();
-        auto now = std::chrono::system_clock::now();
-        auto duration = now.time_since_epoch();
-        this->currentTime = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+        this->currentTime = SystemTimeMillis();
 
         glClear(GL_DEPTH_BUFFER_BIT);
         glEnable(GL_DEPTH_TEST);
@@ -229,13 +275,10 @@ void ClientApp::Run()
 
         this->window->Update();
 
-        if (this->controlledShip != nullptr)
+        Game::SpaceShip* controlledShip = this->GetControlledSpaceShip();
+        if (controlledShip != nullptr)
         {
-            this->controlledShip->SetThisCamera(dt);        
-        }
-        else
-        {
-            this->GetControlledSpaceShip();
+            controlledShip->SetThisCamera(dt);        
         }
 
         if (kbd->pressed[Input::Key::Code::End])
@@ -285,21 +328,30 @@ void ClientApp::OnServerDisconnect()
 {
     this->console->AddOutput("[INFO] server disconnected");
 
-    // remove other ships
+    // remove all ships, the own one too. the client reconnects on its own and the server spawns a new ship
+    // for the new session, which ClientConnect names
     for (auto& spaceShip : this->spaceShips)
-        if (spaceShip != this->controlledShip)
-            delete spaceShip;
+        delete spaceShip;
     
-    this->spaceShips.clear();
-
-    if (this->controlledShip != nullptr)
-        this->spaceShips.push_back(this->controlledShip);
+    this->spaceShips.Clear();
+    this->controlledShip = {};
+    this->controlledShipId = 0;
+    this->hasReceivedSpaceShip = false;
 
     // remove lasers
     for (auto& laser : this->lasers)
         delete laser;
 
-    this->lasers.clear();
+    this->lasers.Clear();
+
+    // the next server has a clock of its own
+    this->clockSync.Clear();
+    this->lastClockSync = 0;
+
+    // a new connection starts a new snapshot sequence
+    this->snapshots.Clear();
+    this->lastSnapshot = 0;
+    this->prediction.Clear();
 }
 
 
@@ -311,12 +363,13 @@ void ClientApp::RenderUI()
     {
         this->console->Draw();
 
-        if (this->controlledShip != nullptr)
+        Game::SpaceShip* controlledShip = this->GetControlledSpaceShip();
+        if (controlledShip != nullptr)
         {
-            float speed = this->controlledShip->currentSpeed;
+            float speed = controlledShip->currentSpeed;
             std::string str = "SPEED: " + std::to_string(speed);
-            glm::vec3 pos = this->controlledShip->position + this->controlledShip->direction * glm::vec3(0.f, -2.f, 0.f);
-            glm::vec4 col = glm::mix(glm::vec4(1.f, 1.f, 1.f, 1.f), glm::vec4(1.0f, 0.2f, 0.2f, 1.f), speed / this->controlledShip->boostSpeed);
+            glm::vec3 pos = controlledShip->position + controlledShip->direction * glm::vec3(0.f, -2.f, 0.f);
+            glm::vec4 col = glm::mix(glm::vec4(1.f, 1.f, 1.f, 1.f), glm::vec4(1.0f, 0.2f, 0.2f, 1.f), speed / controlledShip->boostSpeed);
             Debug::DrawDebugText(str.c_str(), pos, col);
         }
 
@@ -326,25 +379,46 @@ void ClientApp::RenderUI()
 
 void ClientApp::UpdateNetwork()
 {
-    if (this->client == nullptr || this->client->server == nullptr)
+    // everything built last frame has been copied into the send queues
+    this->messages.Reset();
+
+    if (this->client == nullptr)
         return;
 
+    // connection attempts and retries run in Update, nothing to send or read until the server answered
+    if (this->client->server == nullptr)
+    {
+        this->client->Update();
+        return;
+    }
+
     // get input data and send it to server
     unsigned short inputData = this->CompressInputData(this->GetInputData());
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
-    auto outPacket = Protocol::CreateInputC2S(builder, this->currentTime, inputData);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_InputC2S, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->client->SendData(builder.GetBufferPointer(), builder.GetSize(), this->client->server, ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
-
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+    auto outPacket = Protocol::CreateInputC2S(builder, this->currentTime, inputData, this->lastSnapshot);
+    this->FinishPacket(builder, Protocol::PacketType_InputC2S, outPacket.Union());
+    this->client->SendData(builder.GetBufferPointer(), builder.GetSize(), this->client->server, ChannelFor(Protocol::PacketType_InputC2S));
+
+    // ping the server for its clock, the pongs with the shortest round trips give the offset
+    int interval = Core::CVarReadInt(Core::CVarGet("cl_clocksync"));
+    if (this->currentTime >= this->lastClockSync + (uint64)std::max(interval, 1))
+    {
+        this->lastClockSync = this->currentTime;
+        flatbuffers::FlatBufferBuilder& syncBuilder = this->messages.Acquire();
+        auto syncPacket = Protocol::CreateClockSyncC2S(syncBuilder, SystemTimeMillis());
+        this->FinishPacket(syncBuilder, Protocol::PacketType_ClockSyncC2S, syncPacket.Union());
+        this->client->SendData(syncBuilder.GetBufferPointer(), syncBuilder.GetSize(), this->client->server, ChannelFor(Protocol::PacketType_ClockSyncC2S));
+    }
+    this->client->Flush();
 
     // read data from server
     this->client->Update();
+    this->client->stats.Report(this->currentTime);
 
     Game::PeerData d;
     while (this->client->PopDataStack(d))
     {
-        auto packet = Protocol::GetPacketWrapper(&d.data->front());
+        auto packet = Protocol::GetPacketWrapper(d.data);
         Protocol::PacketType packetType = packet->packet_type();
         switch (packetType)
         {
@@ -366,36 +440,76 @@ void ClientApp::UpdateNetwork()
         case Protocol::PacketType::PacketType_TeleportPlayerS2C:
             this->HandleMsgTeleportPlayer(packet);
             break;
-        case Protocol::PacketType::PacketType_SpawnLaserS2C:
-            this->HandleMsgSpawnLaser(packet);
-            break;
-        case Protocol::PacketType::PacketType_DespawnLaserS2C:
-            this->HandleMsgDespawnLaser(packet);
+        case Protocol::PacketType::PacketType_LaserEventsS2C:
+            this->HandleMsgLaserEvents(packet);
             break;
         case Protocol::PacketType::PacketType_TextS2C:
             this->HandleMsgText(packet);
             break;
+        case Protocol::PacketType::PacketType_SnapshotS2C:
+            this->HandleMsgSnapshot(packet);
+            break;
+        case Protocol::PacketType::PacketType_ClockSyncS2C:
+            this->HandleMsgClockSync(packet);
+            break;
         }
     }
+
+    if (this->clockSync.IsSynced())
+        this->timeDiff = (uint64)this->clockSync.Offset(this->currentTime);
 }
 
-void ClientApp::GetControlledSpaceShip()
+Game::SpaceShip* ClientApp::GetControlledSpaceShip()
 {
-    if (!this->hasReceivedSpaceShip)
-        return;
-
-    size_t index = this->SpaceShipIndex(this->controlledShipId);
-    if (index < spaceShips.size())
-        this->controlledShip = spaceShips[index];
+    // the handle stops resolving once the ship is despawned, the id finds the one spawned in its place
+    Game::SpaceShip** spaceShip = this->spaceShips.Get(this->controlledShip);
+    if (spaceShip == nullptr && this->hasReceivedSpaceShip)
+    {
+        this->controlledShip = this->spaceShips.HandleOf(this->controlledShipId);
+        spaceShip = this->spaceShips.Get(this->controlledShip);
+    }
+    return spaceShip != nullptr ? *spaceShip : nullptr;
 }
 
 void ClientApp::UpdateSpaceShips(float deltaTime)
 {
+    bool connected = this->client != nullptr && this->client->server != nullptr;
+    bool batch = Core::CVarReadInt(Core::CVarGet("cl_interp_batch")) != 0;
+    uint64 serverNow = this->currentTime - this->timeDiff;
+    Game::SpaceShip* controlledShip = this->GetControlledSpaceShip();
+    this->interpolation.Clear();
+    this->interpolatedShips.clear();
     for (size_t i = 0; i < this->spaceShips.size(); i++)
     {
-        this->spaceShips[i]->ClientUpdate(deltaTime);
-        Render::RenderDevice::Draw(this->spaceShipModel, this->spaceShips[i]->transform);
+        Game::SpaceShip* spaceShip = this->spaceShips[i];
+        // the own ship moves on local input right away, the server's state only corrects it
+        if (spaceShip == controlledShip)
+        {
+            if (connected)
+                this->prediction.Predict(*controlledShip, this->GetInputData(), deltaTime);
+        }
+        else if (batch && spaceShip->deadReck.mode == Game::DeadReck::Mode::Buffer)
+        {
+            this->interpolation.Add(spaceShip->deadReck.Advance(deltaTime, serverNow));
+            this->interpolatedShips.push_back(spaceShip);
+        }
+        else
+        {
+            spaceShip->ClientUpdate(deltaTime, serverNow);
+        }
+    }
+
+    // the buffered ships are evaluated four at a time
+    this->interpolation.Run();
+    for (size_t i = 0; i < this->interpolatedShips.size(); i++)
+    {
+        Game::DeadReck::Body body = this->interpolation.Body(i);
+        this->interpolatedShips[i]->deadReck.Show(body);
+        this->interpolatedShips[i]->ClientApply(body, this->interpolation.Transform(i));
     }
+
+    for (Game::SpaceShip* spaceShip : this->spaceShips)
+        Render::RenderDevice::Draw(this->spaceShipModel, spaceShip->transform);
 }
 
 void ClientApp::UpdateLasers()
@@ -441,23 +555,44 @@ void ClientApp::UnpackLaser(const Protocol::Laser* laser, glm::vec3& origin, glm
     orientation = glm::quat(p_dir.w(), p_dir.x(), p_dir.y(), p_dir.z());
 }
 
+void ClientApp::UnpackPlayerState(const Protocol::PlayerState* player, glm::vec3& position, glm::vec3& velocity, glm::quat& orientation, uint32& id)
+{
+    id = player->uuid();
+    position = Game::DequantizePosition(player->position_x(), player->position_y(), player->position_z());
+    velocity = Game::DequantizeVelocity(player->velocity(), Game::SpaceShip::boostSpeed);
+    orientation = Game::DequantizeOrientation(player->direction());
+}
+
+void ClientApp::UnpackLaserSpawn(const Protocol::LaserSpawn* laser, uint64 batchTime, glm::vec3& origin, glm::quat& orientation, uint64& spawnTime, uint64& despawnTime)
+{
+    spawnTime = (uint64)((int64)batchTime + laser->start_delta());
+    despawnTime = spawnTime + laser->lifetime();
+    origin = Game::DequantizePosition(laser->origin_x(), laser->origin_y(), laser->origin_z());
+    orientation = Game::DequantizeOrientation(laser->direction());
+}
+
 void ClientApp::HandleMsgClientConnect(const Protocol::PacketWrapper* packet)
 {
     const Protocol::ClientConnectS2C* inPacket = static_cast<const Protocol::ClientConnectS2C*>(packet->packet());
     this->controlledShipId = inPacket->uuid();
+    // a first guess that is off by the one way delay, clock sync takes over with its first answer
     uint64 serverTime = inPacket->time();
-    this->timeDiff = this->currentTime - serverTime;
+    if (!this->clockSync.IsSynced())
+        this->timeDiff = this->currentTime - serverTime;
 
     this->hasReceivedSpaceShip = true;
 }
 
 void ClientApp::HandleMsgGameState(const Protocol::PacketWrapper* packet) 
 {
+    // the state arrives in chunks over several ticks, the first one has the controlled ship so simulation starts with it
     const Protocol::GameStateS2C* inPacket = static_cast<const Protocol::GameStateS2C*>(packet->packet());
     auto p_players = inPacket->players();
     auto p_lasers = inPacket->lasers();
+    if (inPacket->last())
+        this->console->AddOutput("[INFO] game state received in " + std::to_string(inPacket->chunk() + 1) + " chunks");
 
-    for (size_t i = 0; i < p_players->size(); i++)
+    for (size_t i = 0; p_players != nullptr && i < p_players->size(); i++)
     {
         auto p_player = p_players->operator[](i);
         glm::vec3 position;
@@ -468,18 +603,19 @@ void ClientApp::HandleMsgGameState(const Protocol::PacketWrapper* packet)
         this->UnpackPlayer(p_player, position, velocity, acceleration, orientation, id);
 
         // space ship already spawned
-        if (this->SpaceShipIndex(id) < this->spaceShips.size())
+        if (this->spaceShips.Find(id) != nullptr)
         {
-            this->UpdateSpaceShipData(position, velocity, acceleration, orientation, id, true, 0);
+            this->UpdateSpaceShipData(position, velocity, acceleration, orientation, id, true, packet->tick(), this->currentTime - this->timeDiff);
         }
         // space ship is new and must be spawned
         else
         {
             this->SpawnSpaceShip(position, id);
+            this->UpdateSpaceShipData(position, velocity, acceleration, orientation, id, true, packet->tick(), this->currentTime - this->timeDiff);
         }
     }
 
-    for (size_t i = 0; i < p_lasers->size(); i++)
+    for (size_t i = 0; p_lasers != nullptr && i < p_lasers->size(); i++)
     {
         auto p_laser = p_lasers->operator[](i);
         glm::vec3 origin;
@@ -489,7 +625,7 @@ void ClientApp::HandleMsgGameState(const Protocol::PacketWrapper* packet)
         this->UnpackLaser(p_laser, origin, orientation, spawnTime, despawnTime, id);
 
         // laser is new and must be spawned
-        if (this->LaserIndex(id) >= this->lasers.size())
+        if (this->lasers.Find(id) == nullptr)
         {
             this->SpawnLaser(origin, orientation, 0, spawnTime, despawnTime, id);
         }
@@ -507,10 +643,11 @@ void ClientApp::HandleMsgSpawnPlayer(const Protocol::PacketWrapper* packet)
     uint32 id;
     this->UnpackPlayer(p_player, position, velocity, acceleration, orientation, id);
 
-    // space ship is new and must be spawned
-    if (this->SpaceShipIndex(id) >= this->spaceShips.size())
+    // space ship is new and must be spawned, it is shown from its first state on
+    if (this->spaceShips.Find(id) == nullptr)
     {
         this->SpawnSpaceShip(position, id);
+        this->UpdateSpaceShipData(position, velocity, acceleration, orientation, id, true, packet->tick(), this->currentTime - this->timeDiff);
     }
 }
 
@@ -529,7 +666,7 @@ void ClientApp::HandleMsgUpdatePlayer(const Protocol::PacketWrapper* packet)
     uint32 id;
     this->UnpackPlayer(p_player, position, velocity, acceleration, direction, id);
 
-    this->UpdateSpaceShipData(position, velocity, acceleration, direction, id, false, inPacket->time());
+    this->UpdateSpaceShipData(position, velocity, acceleration, direction, id, false, packet->tick(), inPacket->time());
 }
 
 void ClientApp::HandleMsgTeleportPlayer(const Protocol::PacketWrapper* packet)
@@ -541,30 +678,44 @@ void ClientApp::HandleMsgTeleportPlayer(const Protocol::PacketWrapper* packet)
     uint32 id;
     this->UnpackPlayer(p_player, position, velocity, acceleration, direction, id);
 
-    this->UpdateSpaceShipData(position, velocity, acceleration, direction, id, true, inPacket->time());
+    this->UpdateSpaceShipData(position, velocity, acceleration, direction, id, true, packet->tick(), inPacket->time());
 }
 
-void ClientApp::HandleMsgSpawnLaser(const Protocol::PacketWrapper* packet)
+void ClientApp::HandleMsgLaserEvents(const Protocol::PacketWrapper* packet)
 {
-    const Protocol::SpawnLaserS2C* inPacket = static_cast<const Protocol::SpawnLaserS2C*>(packet->packet());
-    auto p_laser = inPacket->laser();
-    glm::vec3 origin;
-    glm::quat direction;
-    uint64 spawnTime, despawnTime;
-    uint32 id;
-    this->UnpackLaser(p_laser, origin, direction, spawnTime, despawnTime, id);
+    const Protocol::LaserEventsS2C* inPacket = static_cast<const Protocol::LaserEventsS2C*>(packet->packet());
 
-    // laser is new and must be spawned
-    if (this->LaserIndex(id) >= this->lasers.size())
+    // lasers that are gone, a hit ends the laser and the ship's respawn follows as its own message
+    uint32 id = inPacket->base_uuid();
+    if (inPacket->despawned() != nullptr)
     {
-        this->SpawnLaser(origin, direction, 0, spawnTime, despawnTime, id);
+        for (uint16 delta : *inPacket->despawned())
+            this->DespawnLaser(id += delta);
+    }
+    id = inPacket->base_uuid();
+    if (inPacket->hits() != nullptr)
+    {
+        for (const Protocol::LaserHit* hit : *inPacket->hits())
+            this->DespawnLaser(id += hit->uuid_delta());
     }
-}
 
-void ClientApp::HandleMsgDespawnLaser(const Protocol::PacketWrapper* packet)
-{
-    const Protocol::DespawnLaserS2C* inPacket = static_cast<const Protocol::DespawnLaserS2C*>(packet->packet());
-    this->DespawnLaser(inPacket->uuid());
+    if (inPacket->spawned() == nullptr)
+        return;
+
+    id = inPacket->base_uuid();
+    for (const Protocol::LaserSpawn* p_laser : *inPacket->spawned())
+    {
+        // lasers the client already has from the game state are not spawned twice
+        id += p_laser->uuid_delta();
+        if (this->lasers.Find(id) != nullptr)
+            continue;
+
+        glm::vec3 origin;
+        glm::quat direction;
+        uint64 spawnTime, despawnTime;
+        this->UnpackLaserSpawn(p_laser, inPacket->time(), origin, direction, spawnTime, despawnTime);
+        this->SpawnLaser(origin, direction, 0, spawnTime, despawnTime, id);
+    }
 }
 
 void ClientApp::HandleMsgText(const Protocol::PacketWrapper* packet)
@@ -575,6 +726,92 @@ void ClientApp::HandleMsgText(const Protocol::PacketWrapper* packet)
     this->console->AddOutput(msg);
 }
 
+void ClientApp::HandleMsgClockSync(const Protocol::PacketWrapper* packet)
+{
+    const Protocol::ClockSyncS2C* inPacket = static_cast<const Protocol::ClockSyncS2C*>(packet->packet());
+    this->clockSync.AddSample(inPacket->client_time(), inPacket->server_time(), SystemTimeMillis());
+}
+
+void ClientApp::HandleMsgSnapshot(const Protocol::PacketWrapper* packet)
+{
+    const Protocol::SnapshotS2C* inPacket = static_cast<const Protocol::SnapshotS2C*>(packet->packet());
+    uint32 sequence = inPacket->sequence();
+
+    // snapshots are unreliable, ignore anything older than what is already applied
+    if (sequence <= this->lastSnapshot)
+        return;
+
+    static const std::vector<Protocol::PlayerState> emptySnapshot;
+    const std::vector<Protocol::PlayerState>* baseline = &emptySnapshot;
+    if (inPacket->baseline() != 0)
+    {
+        auto found = this->snapshots.Find(inPacket->baseline());
+        if (found == nullptr)
+            return; // baseline is gone, the server keeps encoding against our last ack until a decodable one arrives
+
+        baseline = &found->states;
+    }
+
+    // only states that came with this snapshot are applied, and only if they are not the ones applied already. a
+    // ship held back by the server's bandwidth budget keeps an older state, which must not be taken for this tick's
+    auto p_players = inPacket->players();
+    auto p_removed = inPacket->removed();
+    auto stateLess = [](const Protocol::PlayerState& a, const Protocol::PlayerState& b)
+    {
+        return a.uuid() < b.uuid();
+    };
+    auto applied = this->snapshots.Find(this->lastSnapshot);
+    this->snapshotUpdates.clear();
+    for (size_t i = 0; p_players != nullptr && i < p_players->size(); i++)
+    {
+        const Protocol::PlayerState& state = *p_players->Get((flatbuffers::uoffset_t)i);
+        if (applied != nullptr)
+        {
+            auto found = std::lower_bound(applied->states.begin(), applied->states.end(), state, stateLess);
+            if (found != applied->states.end() && found->uuid() == state.uuid() && std::memcmp(&*found, &state, sizeof(state)) == 0)
+                continue;
+        }
+        this->snapshotUpdates.push_back(state);
+    }
+
+    // rebuild the full snapshot from the baseline and the delta, into scratch first since storing it may
+    // overwrite the baseline's slot
+    Game::ApplySnapshotDelta(*baseline,
+        p_players != nullptr ? reinterpret_cast<const Protocol::PlayerState*>(p_players->Data()) : nullptr, p_players != nullptr ? p_players->size() : 0,
+        p_removed != nullptr ? p_removed->data() : nullptr, p_removed != nullptr ? p_removed->size() : 0,
+        this->snapshotScratch);
+    std::vector<Protocol::PlayerState>& states = this->snapshots.Store(sequence).states;
+    states.swap(this->snapshotScratch);
+    this->lastSnapshot = sequence;
+
+    // accelerations are only on the wire when they are non zero
+    auto p_accelerations = inPacket->accelerations();
+    Game::SpaceShip* controlledShip = this->GetControlledSpaceShip();
+    for (const Protocol::PlayerState& p_player : this->snapshotUpdates)
+    {
+        glm::vec3 position, velocity;
+        glm::quat direction;
+        uint32 id;
+        this->UnpackPlayerState(&p_player, position, velocity, direction, id);
+
+        glm::vec3 acceleration = glm::vec3(0.f);
+        for (size_t i = 0; p_accelerations != nullptr && i < p_accelerations->size(); i++)
+        {
+            auto p_acceleration = p_accelerations->Get((flatbuffers::uoffset_t)i);
+            if (p_acceleration->uuid() == p_player.uuid())
+            {
+                auto& p_acc = p_acceleration->acceleration();
+                acceleration = glm::vec3(p_acc.x(), p_acc.y(), p_acc.z());
+                break;
+            }
+        }
+
+        if (controlledShip != nullptr && id == controlledShip->id)
+            this->prediction.Reconcile(*controlledShip, position, velocity, direction, inPacket->input_ack());
+        else
+            this->UpdateSpaceShipData(position, velocity, acceleration, direction, id, false, packet->tick(), inPacket->time());
+    }
+}
 
 //utility functions
 
@@ -603,20 +840,10 @@ Game::Input ClientApp::GetInputData()
     return data;
 }
 
-size_t ClientApp::SpaceShipIndex(uint32 spaceShipId)
+void ClientApp::FinishPacket(flatbuffers::FlatBufferBuilder& builder, Protocol::PacketType type, flatbuffers::Offset<void> packet)
 {
-    size_t index = 0;
-    for (; index < this->spaceShips.size() && this->spaceShips[index]->id != spaceShipId; index++);
-
-    return index;
-}
-
-size_t ClientApp::LaserIndex(uint32 laserId)
-{
-    size_t index = 0;
-    for (; index < this->lasers.size() && this->lasers[index]->id != laserId; index++);
-
-    return index;
+    auto packetWrapper = Protocol::CreatePacketWrapper(builder, type, packet);
+    builder.Finish(packetWrapper);
 }
 
 //methods in response to server messages
@@ -626,52 +853,67 @@ void ClientApp::SpawnSpaceShip(const glm::vec3& position, uint32 spaceShipId)
     Game::SpaceShip* spaceShip = new Game::SpaceShip();
     spaceShip->id = spaceShipId;
     spaceShip->position = position;
-    this->spaceShips.push_back(spaceShip);
+    bool buffered = Core::CVarReadInt(Core::CVarGet("cl_interp")) != 0;
+    spaceShip->deadReck.mode = buffered ? Game::DeadReck::Mode::Buffer : Game::DeadReck::Mode::Blend;
+    this->spaceShips.Insert(spaceShipId, spaceShip);
 }
 
 void ClientApp::DespawnSpaceShip(uint32 spaceShipId)
 {
-    size_t index = this->SpaceShipIndex(spaceShipId);
+    Game::SpaceShip** spaceShip = this->spaceShips.Find(spaceShipId);
 
-    if (index >= this->spaceShips.size())
+    if (spaceShip == nullptr)
         return;
 
-    delete this->spaceShips[index];
-    this->spaceShips.erase(this->spaceShips.begin() + index);
+    delete *spaceShip;
+    this->spaceShips.Erase(spaceShipId);
 }
 
-void ClientApp::UpdateSpaceShipData(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& acceleration, const glm::quat& direction, uint32 spaceShipId, bool hardReset, uint64 timeStamp)
+void ClientApp::UpdateSpaceShipData(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& acceleration, const glm::quat& direction, uint32 spaceShipId, bool hardReset, uint64 tick, uint64 serverTime)
 {
-    size_t index = this->SpaceShipIndex(spaceShipId);
+    Game::SpaceShip** spaceShip = this->spaceShips.Find(spaceShipId);
 
-    if (index >= this->spaceShips.size())
+    if (spaceShip == nullptr)
         return;
 
-    this->spaceShips[index]->SetServerData(position, velocity, acceleration, direction, hardReset, timeStamp);
+    // the controlled ship is predicted, only a teleport moves it outright
+    Game::SpaceShip* controlledShip = this->GetControlledSpaceShip();
+    if (*spaceShip == controlledShip)
+    {
+        if (hardReset)
+        {
+            this->prediction.Clear();
+            this->prediction.Reconcile(*controlledShip, position, velocity, direction, 0);
+        }
+        return;
+    }
+
+    // updates are ordered by the server tick they were sent on
+    (*spaceShip)->SetServerData(position, velocity, acceleration, direction, hardReset, tick, serverTime, this->currentTime);
 }
 
 
 void ClientApp::SpawnLaser(const glm::vec3& origin, const glm::quat& direction, uint32 spaceShipId, uint64 spawnTime, uint64 despawnTime, uint32 laserId)
 {
     Game::Laser* laser = new Game::Laser(laserId, spawnTime + this->timeDiff, despawnTime + this->timeDiff, origin, direction, spaceShipId);
-    this->lasers.push_back(laser);
+    this->lasers.Insert(laserId, laser);
 }
 
 void ClientApp::DespawnLaser(uint32 laserId)
 {
-    size_t index = 0;
-    for (; index < this->lasers.size() && this->lasers[index]->id != laserId; index++);
+    Game::Laser** laser = this->lasers.Find(laserId);
 
-    if (index >= this->lasers.size())
+    if (laser == nullptr)
         return;
 
-    delete this->lasers[index];
-    this->lasers.erase(this->lasers.begin() + index);
+    delete *laser;
+    this->lasers.Erase(laserId);
 }
 
 void ClientApp::DespawnLaserDirect(size_t laserIndex)
 {
+    // the last laser moves into the gap, callers iterating backwards have already seen it
     delete this->lasers[laserIndex];
-    this->lasers.erase(this->lasers.begin() + laserIndex);
+    this->lasers.EraseAt(laserIndex);
 }
 
@@ -8,6 +8,13 @@
 #include "networking/network.h"
 #include "networking/spaceship.h"
 #include "networking/laser.h"
+#include "networking/snapshot.h"
+#include "networking/quantize.h"
+#include "networking/messagearena.h"
+#include "networking/prediction.h"
+#include "networking/slotmap.h"
+#include "networking/clocksync.h"
+#include "networking/interpolation.h"
 #include <vector>
 #include "..\..\generated\flat\proto.h"
 
@@ -28,34 +35,37 @@ private:
 	// updates
 	void RenderUI();
 	void UpdateNetwork();
-	void GetControlledSpaceShip();
+	// nullptr until the server spawned it, and after it was despawned
+	Game::SpaceShip* GetControlledSpaceShip();
 	void UpdateSpaceShips(float deltaTime);
 	void UpdateLasers();
 
 	// unpack messages from server
 	void UnpackPlayer(const Protocol::Player* player, glm::vec3& position, glm::vec3& velocity, glm::vec3& acceleration, glm::quat& orientation, uint32& id);
 	void UnpackLaser(const Protocol::Laser* laser, glm::vec3& origin, glm::quat& direction, uint64& spawnTime, uint64& despawnTime, uint32& id);
+	void UnpackPlayerState(const Protocol::PlayerState* player, glm::vec3& position, glm::vec3& velocity, glm::quat& orientation, uint32& id);
+	void UnpackLaserSpawn(const Protocol::LaserSpawn* laser, uint64 batchTime, glm::vec3& origin, glm::quat& direction, uint64& spawnTime, uint64& despawnTime);
 	void HandleMsgClientConnect(const Protocol::PacketWrapper* packet);
 	void HandleMsgGameState(const Protocol::PacketWrapper* packet);
 	void HandleMsgSpawnPlayer(const Protocol::PacketWrapper* packet);
 	void HandleMsgDespawnPlayer(const Protocol::PacketWrapper* packet);
 	void HandleMsgUpdatePlayer(const Protocol::PacketWrapper* packet);
 	void HandleMsgTeleportPlayer(const Protocol::PacketWrapper* packet);
-	void HandleMsgSpawnLaser(const Protocol::PacketWrapper* packet);
-	void HandleMsgDespawnLaser(const Protocol::PacketWrapper* packet);
+	void HandleMsgLaserEvents(const Protocol::PacketWrapper* packet);
 	void HandleMsgText(const Protocol::PacketWrapper* packet);
+	void HandleMsgSnapshot(const Protocol::PacketWrapper* packet);
+	void HandleMsgClockSync(const Protocol::PacketWrapper* packet);
 
 	// utility functions
 	unsigned short CompressInputData(const Game::Input& data);
 	Game::Input GetInputData();
-	size_t SpaceShipIndex(uint32 spaceShipId);
-	size_t LaserIndex(uint32 laserId);
+	void FinishPacket(flatbuffers::FlatBufferBuilder& builder, Protocol::PacketType type, flatbuffers::Offset<void> packet);
 
 	// methods in response to server messages
 	
 	void SpawnSpaceShip(const glm::vec3& position, uint32 spaceShipId);
 	void DespawnSpaceShip(uint32 spaceShipId);
-	void UpdateSpaceShipData(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& acceleration, const glm::quat& direction, uint32 spaceShipId, bool hardReset, uint64 timeStamp);
+	void UpdateSpaceShipData(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& acceleration, const glm::quat& direction, uint32 spaceShipId, bool hardReset, uint64 tick, uint64 serverTime);
 	void SpawnLaser(const glm::vec3& origin, const glm::quat& direction, uint32 spaceShipId, uint64 spawnTime, uint64 despawnTime, uint32 laserId);
 	void DespawnLaser(uint32 laserId);
 	void DespawnLaserDirect(size_t laserIndex);
@@ -63,18 +73,30 @@ private:
 	Display::Window* window;
 	Game::Console* console;
 	Game::Client* client;
+	Game::MessageArena messages;
 	uint64 currentTime;
-	uint64 timeDiff;
+	uint64 timeDiff;			// client minus server time, follows clockSync once it has a sample
+	Game::ClockSync clockSync;
+	uint64 lastClockSync;
+
+	// decoded snapshots, kept as baselines for the server's delta encoding
+	Game::SnapshotHistory<Protocol::PlayerState> snapshots;
+	std::vector<Protocol::PlayerState> snapshotScratch;
+	std::vector<Protocol::PlayerState> snapshotUpdates;	// states of the snapshot being handled that are new to the client
+	uint32 lastSnapshot;
 
 	std::vector<std::tuple<Render::ModelId, Physics::ColliderId, glm::mat4>> asteroids;
 
-	std::vector<Game::Laser*> lasers;
+	Game::SlotMap<Game::Laser*> lasers;
 	Render::ModelId laserModel;
 	float laserSpeed;
 
-	std::vector<Game::SpaceShip*> spaceShips;
+	Game::SlotMap<Game::SpaceShip*> spaceShips;
+	Game::InterpolationBatch interpolation;
+	std::vector<Game::SpaceShip*> interpolatedShips;
 	bool hasReceivedSpaceShip;
 	uint32 controlledShipId;
-	Game::SpaceShip* controlledShip;
+	Game::SlotMap<Game::SpaceShip*>::Handle controlledShip;
+	Game::Prediction prediction;
 	Render::ModelId spaceShipModel;
 };
\ No newline at end of file
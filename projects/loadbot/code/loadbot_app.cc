@@ -0,0 +1,381 @@
+#include "config.h"
+#include "loadbot_app.h"
+#include "core/random.h"
+#include "core/cvar.h"
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+
+// set from the signal handler, stops the run early but still writes the report
+static volatile std::sig_atomic_t quitRequested = 0;
+
+static uint64 WallClockMillis()
+{
+    auto duration = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+LoadBotApp::LoadBotApp() :
+    console(nullptr),
+    currentTime(0),
+    startTime(0),
+    running(false)
+{}
+
+LoadBotApp::~LoadBotApp() {}
+
+bool LoadBotApp::Open()
+{
+    App::Open();
+    std::signal(SIGINT, [](int) { quitRequested = 1; });
+    std::signal(SIGTERM, [](int) { quitRequested = 1; });
+
+    if (enet_initialize() != 0)
+    {
+        printf("\n[ERROR] failed to initialize ENet.\n");
+        return false;
+    }
+    atexit(enet_deinitialize);
+
+    Core::CVarCreate(Core::CVarType::CVar_Int, "lb_bots", "100", "number of simulated clients");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "lb_input_rate", "30", "inputs per second sent by every bot");
+    Core::CVarCreate(Core::CVarType::CVar_Float, "lb_fire", "0.2", "chance that an input holds the fire button");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "lb_pattern", "0", "0 steers at random, 1 flies a fixed circle");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "lb_duration", "60", "seconds to run after all bots have connected");
+    Core::CVarCreate(Core::CVarType::CVar_String, "lb_report", "loadbot_report.txt", "file the summary is written to");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "net_compression", "0", "0 sends datagrams as they are, 1 with ENet's range coder, 2 with the net_dictionary compressor, server and clients must match");
+    Core::CVarCreate(Core::CVarType::CVar_String, "net_dictionary", "net_dictionary.bin", "dictionary file for net_compression 2, trained with the server's dictionary command");
+
+    // setup console commands
+    this->console = new Game::Console("LoadBot", 128, 128, 10);
+    this->console->SetCommand("connect", [this](const std::string& arg)
+    {
+        this->Connect(arg);
+    });
+    this->console->SetCommand("set", [this](const std::string& arg)
+    {
+        size_t split = arg.find(' ');
+        Core::CVar* cvar = Core::CVarGet(arg.substr(0, split).c_str());
+        if (cvar == nullptr || split == std::string::npos)
+        {
+            this->console->AddOutput("[WARNING] usage: set <cvar> <value>");
+            return;
+        }
+
+        Core::CVarParseWrite(cvar, arg.substr(split + 1).c_str());
+    });
+
+    return true;
+}
+
+void LoadBotApp::Run()
+{
+    if (!this->running)
+    {
+        this->console->AddOutput("[WARNING] no bots connected, pass \"connect <ip> <port>\"");
+        return;
+    }
+
+    uint64 duration = (uint64)std::max(1, Core::CVarReadInt(Core::CVarGet("lb_duration"))) * 1000;
+    while (!quitRequested)
+    {
+        this->currentTime = WallClockMillis();
+        if (this->currentTime - this->startTime >= duration)
+            break;
+
+        size_t connected = 0;
+        for (Bot& bot : this->bots)
+        {
+            this->UpdateBot(bot);
+            connected += bot.connected ? 1 : 0;
+        }
+        this->messages.Reset();
+
+        if (connected == 0)
+        {
+            this->console->AddOutput("[WARNING] every bot lost its connection");
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    this->currentTime = WallClockMillis();
+    this->WriteReport();
+}
+
+void LoadBotApp::Exit()
+{
+    for (Bot& bot : this->bots)
+        delete bot.client;
+
+    delete this->console;
+}
+
+void LoadBotApp::Execute(const std::string& command)
+{
+    this->console->Execute(command);
+}
+
+void LoadBotApp::Connect(const std::string& arg)
+{
+    if (this->running)
+        return;
+
+    std::string argIP;
+    enet_uint16 argPort;
+    Game::splitStringSpace(arg, argIP, argPort);
+
+    // the disconnect callbacks index into the bots, so they must not move after this
+    size_t count = (size_t)std::max(1, Core::CVarReadInt(Core::CVarGet("lb_bots")));
+    this->bots.resize(count);
+
+    Game::Compression compression = (Game::Compression)Core::CVarReadInt(Core::CVarGet("net_compression"));
+    const char* dictionary = Core::CVarReadString(Core::CVarGet("net_dictionary"));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Bot& bot = this->bots[i];
+        auto onConnect = [this, i](ENetPeer* server)
+        {
+            this->bots[i].connected = true;
+        };
+        auto onDisconnect = [this, i](ENetPeer* server)
+        {
+            this->bots[i].connected = false;
+        };
+
+        // a bot that lost the server stays out of the measurement
+        bot.client = new Game::Client();
+        bot.client->reconnect = false;
+        if (!bot.client->Init(onConnect, onDisconnect) || !bot.client->SetCompression(compression, dictionary))
+        {
+            // likely out of sockets, the bot sits the run out
+            delete bot.client;
+            bot.client = nullptr;
+            continue;
+        }
+        bot.client->TryConnecting(argIP.c_str(), argPort);
+    }
+
+    // all bots connect at once, wait until each is through or has given up
+    size_t connected = 0;
+    size_t pending = count;
+    while (pending > 0 && !quitRequested)
+    {
+        connected = 0;
+        pending = 0;
+        for (Bot& bot : this->bots)
+        {
+            if (bot.client == nullptr)
+                continue;
+
+            // what arrives before the run starts is not measured
+            bot.client->Update();
+            Game::PeerData data;
+            while (bot.client->PopDataStack(data)) {}
+
+            Game::ConnectionState state = bot.client->GetState();
+            connected += state == Game::ConnectionState::Connected ? 1 : 0;
+            pending += state != Game::ConnectionState::Connected && state != Game::ConnectionState::Idle ? 1 : 0;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    this->console->AddOutput("[INFO] " + std::to_string(connected) + " of " + std::to_string(count) + " bots connected");
+    this->startTime = WallClockMillis();
+    this->currentTime = this->startTime;
+    this->running = connected > 0;
+}
+
+void LoadBotApp::UpdateBot(Bot& bot)
+{
+    if (bot.client == nullptr || !bot.connected)
+        return;
+
+    bot.client->Update();
+
+    Game::PeerData data;
+    while (bot.client->PopDataStack(data))
+    {
+        bot.messagesReceived++;
+        bot.bytesReceived += data.dataSize;
+
+        auto packet = Protocol::GetPacketWrapper(data.data);
+        if (packet->packet_type() == Protocol::PacketType_SnapshotS2C)
+            this->HandleMsgSnapshot(bot, packet);
+    }
+
+    // the disconnect may have come in with this update
+    if (!bot.connected)
+        return;
+
+    if (this->currentTime >= bot.nextInputTime)
+    {
+        this->SendInput(bot);
+        bot.nextInputTime = this->currentTime + 1000 / (uint64)std::max(1, Core::CVarReadInt(Core::CVarGet("lb_input_rate")));
+    }
+
+    bot.client->Flush();
+}
+
+void LoadBotApp::HandleMsgSnapshot(Bot& bot, const Protocol::PacketWrapper* packet)
+{
+    const Protocol::SnapshotS2C* inPacket = static_cast<const Protocol::SnapshotS2C*>(packet->packet());
+    uint32 sequence = inPacket->sequence();
+    // the server's time falls behind the wall clock by every backlog it drops, which happens exactly under load
+    uint64 serverTime = inPacket->time() + inPacket->dropped_time();
+
+    if (bot.firstSequence == 0)
+        bot.firstSequence = sequence;
+    bot.lastSequence = std::max(bot.lastSequence, sequence);
+    bot.snapshotsReceived++;
+
+    bot.latencies.push_back((float)((int64)this->currentTime - (int64)serverTime));
+
+    // difference between how far apart the snapshots arrived and how far apart the server sent them
+    if (bot.lastArrival != 0)
+    {
+        double transit = (double)((int64)(this->currentTime - bot.lastArrival) - (int64)(serverTime - bot.lastServerTime));
+        bot.jitter += (std::abs(transit) - bot.jitter) / 16.0;
+    }
+    bot.lastArrival = this->currentTime;
+    bot.lastServerTime = serverTime;
+}
+
+void LoadBotApp::SendInput(Bot& bot)
+{
+    bot.inputBitmap = this->NextInput(bot);
+
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+    auto outPacket = Protocol::CreateInputC2S(builder, this->currentTime, bot.inputBitmap, bot.lastSequence);
+    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_InputC2S, outPacket.Union());
+    builder.Finish(packetWrapper);
+    bot.client->SendData(builder.GetBufferPointer(), builder.GetSize(), bot.client->server, Game::Channel::State);
+    bot.bytesSent += builder.GetSize();
+
+    bot.rttSum += bot.client->server->roundTripTime;
+    bot.rttSamples++;
+}
+
+uint16 LoadBotApp::NextInput(const Bot& bot)
+{
+    // same bits as ClientApp::CompressInputData, w is 1 and space is 128
+    uint16 bitmap;
+    if (Core::CVarReadInt(Core::CVarGet("lb_pattern")) == 1)
+    {
+        // forward and left, the ship keeps flying the same circle
+        bitmap = 1 | 32;
+    }
+    else
+    {
+        // hold the steering for a while so the ships get somewhere
+        bitmap = bot.inputBitmap & ~128;
+        if (bitmap == 0 || Core::RandomFloat() < 0.1f)
+            bitmap = (uint16)(Core::FastRandom() & 0x17F) | 1;
+    }
+
+    if (Core::RandomFloat() < Core::CVarReadFloat(Core::CVarGet("lb_fire")))
+        bitmap |= 128;
+
+    return bitmap;
+}
+
+void LoadBotApp::WriteReport()
+{
+    const char* path = Core::CVarReadString(Core::CVarGet("lb_report"));
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+        this->console->AddOutput(std::string("[WARNING] could not open ") + path + ", report goes to the console only");
+
+    char line[256];
+    auto emit = [this, file](const char* text, bool summary)
+    {
+        if (summary)
+            this->console->AddOutput(text);
+        if (file != nullptr)
+            fprintf(file, "%s\n", text);
+    };
+
+    double seconds = std::max(0.001, (double)(this->currentTime - this->startTime) / 1000.0);
+    std::vector<float> latencies;
+    size_t connected = 0;
+    uint64 expected = 0, received = 0, rttSum = 0, rttSamples = 0;
+    double downSum = 0.0, downMax = 0.0, upSum = 0.0, jitterSum = 0.0, jitterMax = 0.0;
+    size_t measured = 0;
+
+    for (const Bot& bot : this->bots)
+    {
+        if (bot.client == nullptr || bot.firstSequence == 0)
+            continue;
+
+        measured++;
+        connected += bot.connected ? 1 : 0;
+        latencies.insert(latencies.end(), bot.latencies.begin(), bot.latencies.end());
+        expected += bot.lastSequence - bot.firstSequence + 1;
+        received += bot.snapshotsReceived;
+        rttSum += bot.rttSum;
+        rttSamples += bot.rttSamples;
+
+        double down = (double)bot.bytesReceived / seconds / 1024.0;
+        downSum += down;
+        downMax = std::max(downMax, down);
+        upSum += (double)bot.bytesSent / seconds / 1024.0;
+        jitterSum += bot.jitter;
+        jitterMax = std::max(jitterMax, bot.jitter);
+    }
+
+    auto percentile = [&latencies](double p) -> float
+    {
+        if (latencies.empty())
+            return 0.f;
+        size_t index = std::min(latencies.size() - 1, (size_t)(p * (double)latencies.size()));
+        std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+        return latencies[index];
+    };
+
+    double latencyMean = 0.0;
+    for (float latency : latencies)
+        latencyMean += latency;
+    latencyMean /= std::max<size_t>(1, latencies.size());
+
+    double count = (double)std::max<size_t>(1, measured);
+    double loss = expected > 0 ? 100.0 * (double)(expected - std::min(expected, received)) / (double)expected : 0.0;
+
+    emit("[REPORT] loadbot summary", true);
+    snprintf(line, sizeof(line), "bots: %zu requested, %zu received snapshots, %zu still connected after %.1f s", this->bots.size(), measured, connected, seconds);
+    emit(line, true);
+    snprintf(line, sizeof(line), "snapshot latency ms: mean %.2f, p50 %.2f, p99 %.2f, max %.2f", latencyMean, percentile(0.5), percentile(0.99), percentile(1.0));
+    emit(line, true);
+    snprintf(line, sizeof(line), "enet rtt ms: mean %.2f", rttSamples > 0 ? (double)rttSum / (double)rttSamples : 0.0);
+    emit(line, true);
+    snprintf(line, sizeof(line), "bandwidth per client KiB/s: down mean %.2f, down max %.2f, up mean %.2f", downSum / count, downMax, upSum / count);
+    emit(line, true);
+    snprintf(line, sizeof(line), "snapshot loss: %.2f%% (%llu of %llu)", loss, (unsigned long long)(expected - std::min(expected, received)), (unsigned long long)expected);
+    emit(line, true);
+    snprintf(line, sizeof(line), "tick jitter ms: mean %.2f, max %.2f", jitterSum / count, jitterMax);
+    emit(line, true);
+
+    // one line per bot only goes to the file
+    emit("", false);
+    emit("bot connected snapshots lost down_KiB/s up_KiB/s jitter_ms rtt_ms", false);
+    for (size_t i = 0; i < this->bots.size(); i++)
+    {
+        const Bot& bot = this->bots[i];
+        uint32 botExpected = bot.firstSequence != 0 ? bot.lastSequence - bot.firstSequence + 1 : 0;
+        snprintf(line, sizeof(line), "%zu %d %u %u %.2f %.2f %.2f %.2f", i, bot.connected ? 1 : 0, bot.snapshotsReceived,
+            botExpected - std::min(botExpected, bot.snapshotsReceived),
+            (double)bot.bytesReceived / seconds / 1024.0, (double)bot.bytesSent / seconds / 1024.0, bot.jitter,
+            bot.rttSamples > 0 ? (double)bot.rttSum / (double)bot.rttSamples : 0.0);
+        emit(line, false);
+    }
+
+    if (file != nullptr)
+    {
+        fclose(file);
+        this->console->AddOutput(std::string("[INFO] report written to ") + path);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "core/app.h"
+#include "networking/console.h"
+#include "networking/network.h"
+#include "networking/messagearena.h"
+#include <vector>
+#include "proto.h"
+
+// Opens many simulated client connections to a server and reports how it holds up.
+class LoadBotApp : public Core::App
+{
+public:
+	LoadBotApp();
+	~LoadBotApp();
+
+	bool Open();
+	void Run();
+	void Exit();
+
+	void Execute(const std::string& command);
+
+private:
+	// one simulated player and what it measured
+	struct Bot
+	{
+		Game::Client* client = nullptr;
+		bool connected = false;
+		uint64 nextInputTime = 0;
+		uint16 inputBitmap = 0;
+
+		uint32 firstSequence = 0;
+		uint32 lastSequence = 0;
+		uint32 snapshotsReceived = 0;
+		uint64 messagesReceived = 0;
+		uint64 bytesReceived = 0;
+		uint64 bytesSent = 0;
+
+		// age of every snapshot on arrival in ms, server and bots share the clock on loopback
+		std::vector<float> latencies;
+
+		// interarrival jitter of the snapshots as in RFC 3550
+		double jitter = 0.0;
+		uint64 lastArrival = 0;
+		uint64 lastServerTime = 0;
+
+		uint64 rttSum = 0;
+		uint32 rttSamples = 0;
+	};
+
+	void Connect(const std::string& arg);
+	void UpdateBot(Bot& bot);
+	void HandleMsgSnapshot(Bot& bot, const Protocol::PacketWrapper* packet);
+	void SendInput(Bot& bot);
+	uint16 NextInput(const Bot& bot);
+	void WriteReport();
+
+	Game::Console* console;
+	Game::MessageArena messages;
+	std::vector<Bot> bots;
+	uint64 currentTime;
+	uint64 startTime;
+	bool running;
+};
@@ -0,0 +1,18 @@
+#include "config.h"
+#include "loadbot_app.h"
+
+int
+main(int argc, const char** argv)
+{
+	LoadBotApp app;
+	if (app.Open())
+	{
+		// every argument is a console command, e.g. loadbot "set lb_bots 200" "connect 127.0.0.1 1234"
+		for (int i = 1; i < argc; i++)
+			app.Execute(argv[i]);
+
+		app.Run();
+		app.Close();
+	}
+	app.Exit();
+}
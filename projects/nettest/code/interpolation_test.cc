@@ -0,0 +1,91 @@
+#include "config.h"
+#include "nettest.h"
+#include "networking/interpolation.h"
+#include "networking/quantize.h"
+#include "core/random.h"
+
+namespace NetTest
+{
+    static glm::vec3 RandomVec3(float scale)
+    {
+        return glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) * scale;
+    }
+
+    static Game::DeadReck::Body RandomBody(const glm::quat& orientation)
+    {
+        return { RandomVec3(Game::WorldExtent), RandomVec3(2.f), RandomVec3(1.f), orientation };
+    }
+
+    // the SSE batch against DeadReck::Evaluate, the per ship reference, on random segments of consecutive states
+    void Interpolation()
+    {
+        Game::InterpolationBatch batch;
+        float positionError = 0.f;
+        float velocityError = 0.f;
+        float orientationError = 0.f;
+        float transformError = 0.f;
+
+        // every count up to a few groups of four, so the padded tail is covered too
+        for (size_t count = 1; count <= 37; count++)
+        {
+            std::vector<Game::DeadReck::Segment> segments;
+            batch.Clear();
+            for (size_t i = 0; i < count; i++)
+            {
+                // states arrive a tick or a few apart, the ship turns a few degrees in between. either sign of
+                // the next orientation is the same rotation
+                glm::quat a = glm::normalize(glm::quat(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()));
+                glm::quat b = glm::normalize(a * glm::quat(RandomVec3(0.05f)));
+                if (i % 3 == 0)
+                    b = -b;
+
+                Game::DeadReck::Segment segment = { RandomBody(a), RandomBody(b), Core::RandomFloat(), 0.02f + Core::RandomFloat() * 0.1f, RandomVec3(0.5f) };
+                segments.push_back(segment);
+                batch.Add(segment);
+            }
+            batch.Run();
+
+            NETTEST_CHECK(batch.Size() == count);
+            for (size_t i = 0; i < count; i++)
+            {
+                Game::DeadReck::Body expected = Game::DeadReck::Evaluate(segments[i]);
+                Game::DeadReck::Body body = batch.Body(i);
+                positionError = glm::max(positionError, glm::length(body.position - expected.position));
+                velocityError = glm::max(velocityError, glm::length(body.velocity - expected.velocity));
+                orientationError = glm::max(orientationError, 1.f - glm::abs(glm::dot(body.orientation, expected.orientation)));
+
+                glm::mat4 transform = glm::translate(expected.position) * (glm::mat4)expected.orientation;
+                for (int column = 0; column < 4; column++)
+                    for (int row = 0; row < 4; row++)
+                        transformError = glm::max(transformError, glm::abs(batch.Transform(i)[column][row] - transform[column][row]));
+            }
+        }
+
+        NETTEST_CHECK(positionError <= 2.5e-4f);
+        NETTEST_CHECK(velocityError <= 1e-5f);
+        NETTEST_CHECK(orientationError <= 1e-6f);
+        NETTEST_CHECK(transformError <= 2.5e-4f);
+
+        // a ship flying straight between two states moves along the line at the pace SpaceShip::Simulate gives
+        // its velocity, in both paths
+        glm::vec3 velocity = glm::vec3(0.f, 0.f, 1.f);
+        float span = 0.05f;
+        Game::DeadReck::Body start = { glm::vec3(0.f), velocity, glm::vec3(0.f), glm::identity<glm::quat>() };
+        Game::DeadReck::Body end = { velocity * span * Game::DeadReck::velocityScale, velocity, glm::vec3(0.f), glm::identity<glm::quat>() };
+        float straightError = 0.f;
+        batch.Clear();
+        for (int step = 0; step <= 8; step++)
+        {
+            float t = (float)step / 8.f;
+            Game::DeadReck::Segment segment = { start, end, t, span, glm::vec3(0.f) };
+            batch.Add(segment);
+            straightError = glm::max(straightError, glm::length(Game::DeadReck::Evaluate(segment).position - end.position * t));
+        }
+        batch.Run();
+        for (int step = 0; step <= 8; step++)
+            straightError = glm::max(straightError, glm::length(batch.Body(step).position - end.position * ((float)step / 8.f)));
+        NETTEST_CHECK(straightError <= 1e-5f);
+
+        printf("[INFO] max difference position %g, velocity %g, orientation %g, transform %g\n", positionError, velocityError, orientationError, transformError);
+    }
+}
@@ -0,0 +1,38 @@
+#include "config.h"
+#include "nettest.h"
+#include "networking/dead_reck.h"
+#include <cmath>
+
+namespace NetTest
+{
+    // feeds a state every 50 ms of server time, the local clock is unix ms like the client's. each state arrives
+    // 30 ms after it was sent, give or take spread, and returns the delay the jitter buffer settles on
+    static float SettledDelay(float spread)
+    {
+        const uint64 start = 1760000000000;
+        Game::DeadReck deadReck(0.05f);
+        Game::DeadReck::Body body = { glm::vec3(0.f), glm::vec3(0.f), glm::vec3(0.f), glm::identity<glm::quat>() };
+        uint64 serverTime = start;
+        for (uint32 tick = 1; tick <= 200; tick++)
+        {
+            serverTime = start + tick * 50;
+            uint64 arrivalTime = serverTime + 30 + (tick % 2 == 0 ? (uint64)spread : 0);
+            deadReck.SetServerData(body, false, tick, serverTime, arrivalTime);
+        }
+
+        // the delay moves 100 ms per second towards its target
+        for (int frame = 0; frame < 10; frame++)
+            deadReck.Advance(0.1f, serverTime);
+        return deadReck.Delay();
+    }
+
+    // the arrival gaps alternate between 50 + spread and 50 - spread ms, so the jitter settles on spread and the
+    // delay on the interval plus three times it. at unix ms a float only resolves 131072 ms steps, so the gaps
+    // must be taken before the conversion
+    void Jitter()
+    {
+        NETTEST_CHECK(std::abs(SettledDelay(0.f) - 50.f) < 1.f);
+        NETTEST_CHECK(std::abs(SettledDelay(10.f) - 80.f) < 1.f);
+        NETTEST_CHECK(std::abs(SettledDelay(40.f) - 170.f) < 1.f);
+    }
+}
@@ -0,0 +1,40 @@
+#include "config.h"
+#include "nettest.h"
+#include <cstdio>
+
+static int failures = 0;
+
+bool NetTest::Check(bool passed, const char* expression, const char* file, int line)
+{
+	if (!passed)
+	{
+		printf("\n[ERROR] %s:%d: %s\n", file, line, expression);
+		failures++;
+	}
+	return passed;
+}
+
+int
+main(int argc, const char** argv)
+{
+	struct Test
+	{
+		const char* name;
+		void (*run)();
+	};
+	const Test tests[] = {
+		{ "quantize", NetTest::Quantize },
+		{ "slotmap", NetTest::SlotMap },
+		{ "interpolation", NetTest::Interpolation },
+		{ "jitter", NetTest::Jitter },
+	};
+
+	for (const Test& test : tests)
+	{
+		int before = failures;
+		test.run();
+		printf("[INFO] %s: %s\n", test.name, failures == before ? "passed" : "FAILED");
+	}
+
+	return failures == 0 ? 0 : 1;
+}
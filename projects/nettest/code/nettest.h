@@ -0,0 +1,20 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	Checks of the networking code that can run without a server, a window or a GL context.
+	Every test is a function that reports each failed check, main runs them all.
+*/
+//------------------------------------------------------------------------------
+
+namespace NetTest
+{
+	// counts and prints a failed check, returns whether it passed
+	bool Check(bool passed, const char* expression, const char* file, int line);
+
+	void Quantize();
+	void SlotMap();
+	void Interpolation();
+	void Jitter();
+}
+
+#define NETTEST_CHECK(expression) NetTest::Check((expression), #expression, __FILE__, __LINE__)
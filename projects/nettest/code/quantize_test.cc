@@ -0,0 +1,77 @@
+#include "config.h"
+#include "nettest.h"
+#include "networking/quantize.h"
+#include "networking/spaceship.h"
+#include "core/random.h"
+
+namespace NetTest
+{
+    // round trips random values through the wire formats and holds them to the precision the formats promise
+    void Quantize()
+    {
+        const int samples = 100000;
+
+        // 16 bits over the world, off by at most half a step
+        const float positionBound = Game::WorldExtent / 65535.f + 1e-4f;
+        float positionError = 0.f;
+        for (int i = 0; i < samples; i++)
+        {
+            glm::vec3 position = glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) * Game::WorldExtent;
+            uint16 x, y, z;
+            Game::QuantizePosition(position, x, y, z);
+            glm::vec3 error = glm::abs(Game::DequantizePosition(x, y, z) - position);
+            positionError = glm::max(positionError, glm::max(error.x, glm::max(error.y, error.z)));
+        }
+        NETTEST_CHECK(positionError <= positionBound);
+
+        // 10 bits over +-maxSpeed, off by at most half a step. the two steps next to zero are snapped to it, which
+        // leaves values up to a whole step away from zero off by that much
+        const float maxSpeed = Game::SpaceShip::boostSpeed;
+        const float velocityStep = 2.f * maxSpeed / 1023.f;
+        float velocityError = 0.f;
+        float snappedError = 0.f;
+        for (int i = 0; i < samples; i++)
+        {
+            glm::vec3 velocity = glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) * maxSpeed;
+            glm::vec3 error = glm::abs(Game::DequantizeVelocity(Game::QuantizeVelocity(velocity, maxSpeed), maxSpeed) - velocity);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (glm::abs(velocity[axis]) <= velocityStep)
+                    snappedError = glm::max(snappedError, error[axis]);
+                else
+                    velocityError = glm::max(velocityError, error[axis]);
+            }
+        }
+        NETTEST_CHECK(velocityError <= velocityStep * 0.5f + 1e-6f);
+        NETTEST_CHECK(snappedError <= velocityStep + 1e-6f);
+
+        // a ship at rest stays at rest, and so does one only moving along some axes
+        NETTEST_CHECK(Game::DequantizeVelocity(Game::QuantizeVelocity(glm::vec3(0.f), maxSpeed), maxSpeed) == glm::vec3(0.f));
+        glm::vec3 forward = Game::DequantizeVelocity(Game::QuantizeVelocity(glm::vec3(0.f, 0.f, maxSpeed), maxSpeed), maxSpeed);
+        NETTEST_CHECK(forward.x == 0.f && forward.y == 0.f);
+        NETTEST_CHECK(glm::abs(forward.z - maxSpeed) <= velocityStep * 0.5f);
+
+        // smallest three, 10 bits for each component within +-1/sqrt(2). the bound is on the angle between the
+        // rotations, q and -q being the same one
+        const float orientationBound = glm::radians(0.25f);
+        float orientationError = 0.f;
+        float lengthError = 0.f;
+        for (int i = 0; i < samples; i++)
+        {
+            glm::quat orientation = glm::normalize(glm::quat(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()));
+            if (i % 2 == 1)
+                orientation = -orientation;
+            glm::quat decoded = Game::DequantizeOrientation(Game::QuantizeOrientation(orientation));
+            float dot = glm::min(1.f, glm::abs(glm::dot(orientation, decoded)));
+            orientationError = glm::max(orientationError, 2.f * glm::acos(dot));
+            lengthError = glm::max(lengthError, glm::abs(glm::length(decoded) - 1.f));
+        }
+        NETTEST_CHECK(orientationError <= orientationBound);
+        NETTEST_CHECK(lengthError <= 1e-5f);
+
+        glm::quat identity = Game::DequantizeOrientation(Game::QuantizeOrientation(glm::identity<glm::quat>()));
+        NETTEST_CHECK(glm::abs(glm::dot(identity, glm::identity<glm::quat>())) >= 1.f - 1e-6f);
+
+        printf("[INFO] max error position %f, velocity %f (%f near zero), orientation %f degrees\n", positionError, velocityError, snappedError, glm::degrees(orientationError));
+    }
+}
@@ -0,0 +1,36 @@
+#include "config.h"
+#include "nettest.h"
+#include "networking/slotmap.h"
+
+namespace NetTest
+{
+    // handles kept past their entity's removal must not resolve to whatever reuses the slot
+    void SlotMap()
+    {
+        Game::SlotMap<int> map;
+        Game::SlotMap<int>::Handle first = map.Insert(10, 1);
+        Game::SlotMap<int>::Handle second = map.Insert(20, 2);
+        NETTEST_CHECK(map.Get(first) != nullptr && *map.Get(first) == 1);
+        NETTEST_CHECK(map.HandleOf(20).slot == second.slot && map.HandleOf(20).generation == second.generation);
+
+        // the last value moves into the gap, its handle follows it
+        map.Erase(10);
+        NETTEST_CHECK(map.Get(first) == nullptr);
+        NETTEST_CHECK(map.Get(second) != nullptr && *map.Get(second) == 2);
+        NETTEST_CHECK(map.size() == 1 && map[0] == 2 && map.UuidAt(0) == 20);
+
+        // a new entity in the freed slot is not the old one
+        Game::SlotMap<int>::Handle third = map.Insert(30, 3);
+        NETTEST_CHECK(third.slot == first.slot);
+        NETTEST_CHECK(map.Get(first) == nullptr);
+        NETTEST_CHECK(map.Get(third) != nullptr && *map.Get(third) == 3);
+
+        // inserting a present uuid keeps its handle
+        Game::SlotMap<int>::Handle replaced = map.Insert(30, 4);
+        NETTEST_CHECK(replaced.slot == third.slot && replaced.generation == third.generation && *map.Get(third) == 4);
+
+        map.Clear();
+        NETTEST_CHECK(map.empty() && map.Get(second) == nullptr && map.Get(third) == nullptr && map.Find(20) == nullptr);
+        NETTEST_CHECK(map.Get(map.HandleOf(20)) == nullptr);
+    }
+}
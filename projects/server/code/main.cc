@@ -7,8 +7,13 @@ main(int argc, const char** argv)
 	ServerApp app;
 	if (app.Open())
 	{
+#ifdef HEADLESS
+		// every argument is a console command, e.g. server_headless "set sv_tickrate 30" "server 0.0.0.0 1234"
+		for (int i = 1; i < argc; i++)
+			app.Execute(argv[i]);
+#endif
 		app.Run();
 		app.Close();
 	}
 	app.Exit();
-}
\ No newline at end of file
+}
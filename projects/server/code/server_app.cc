@@ -1,5 +1,6 @@
 #include "config.h"
 #include "server_app.h"
+#ifndef HEADLESS
 #include "render/renderdevice.h"
 #include "render/cameramanager.h"
 #include "render/shaderresource.h"
@@ -7,51 +8,96 @@
 #include "render/lightserver.h"
 #include "render/debugrender.h"
 #include "render/input/inputserver.h"
+#endif
 #include "core/random.h"
+#include "core/cvar.h"
 #include <chrono>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#ifdef HEADLESS
+#include <thread>
+#include <csignal>
+
+// set from the signal handler, a headless server has no window to close
+static volatile std::sig_atomic_t quitRequested = 0;
+#endif
+
+// the wrapper's packet type names a message for the network stats
+static size_t PacketTypeOf(const enet_uint8* data, size_t dataSize)
+{
+    return (size_t)Protocol::GetPacketWrapper(data)->packet_type();
+}
+
+// lifecycle events are reliable and ordered, the state streams must not wait behind them and chat waits for both
+static Game::Channel ChannelFor(Protocol::PacketType type)
+{
+    switch (type)
+    {
+    case Protocol::PacketType_SnapshotS2C:
+    case Protocol::PacketType_UpdatePlayerS2C:
+    case Protocol::PacketType_InputC2S:
+    case Protocol::PacketType_ClockSyncC2S:
+    case Protocol::PacketType_ClockSyncS2C:
+        return Game::Channel::State;
+    case Protocol::PacketType_TextS2C:
+    case Protocol::PacketType_TextC2S:
+        return Game::Channel::Bulk;
+    default:
+        return Game::Channel::Events;
+    }
+}
 
 ServerApp::ServerApp():
+#ifndef HEADLESS
 	window(nullptr),
+#endif
 	console(nullptr),
 	server(nullptr),
     currentTime(0),
+    tick(0),
+    startTime(0),
+    simulationTime(0.0),
+    droppedTime(0.0),
+    replaying(false),
+    replayRealTime(false),
+    replayStartTick(0),
+#ifndef HEADLESS
     spaceShipModel(0),
+    laserModel(0),
+#endif
     nextSpaceShipId(0),
     spaceShipCollisionRadiusSquared(0.f),
-    laserModel(0),
     nextLaserId(0),
     laserMaxTime(0),
     laserSpeed(0.f),
-    laserCooldown(0.1f)
+    laserCooldown(0.1f),
+    interestRadius(60.f),
+    shipGrid(30.f),
+    laserGrid(30.f)
 {}
 
 ServerApp::~ServerApp(){}
 
 bool ServerApp::Open()
 {
-    int width = 1280; 
-    int height = 720;
-
-	// setup window and rendering
 	App::Open();
-	this->window = new Display::Window;
-	this->window->SetSize(width, height);
-
-	if (!this->window->Open())
+#ifndef HEADLESS
+	if (!this->OpenWindow())
 		return false;
-
-	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-	Render::RenderDevice::Init();
-
-	this->window->SetUiRender([this]()
-	{
-		this->RenderUI();
-	});
-
-    // setup main camera
-    Render::Camera* cam = Render::CameraManager::GetCamera(CAMERA_MAIN);
-    cam->projection = glm::perspective(glm::radians(90.0f), float(width) / float(height), 0.01f, 1000.f);
-    cam->view = glm::lookAt(glm::vec3(0.f, 0.f, -100.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+#else
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_spinwait", "1", "ms before each tick that are spun instead of slept, for tighter pacing");
+    std::signal(SIGINT, [](int) { quitRequested = 1; });
+    std::signal(SIGTERM, [](int) { quitRequested = 1; });
+#endif
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_tickrate", "60", "simulation ticks per second");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_maxticks", "5", "ticks run back to back before a backlog is dropped");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_lagcomp_max", "500", "most ms lasers are tested against the past ship positions, 0 disables lag compensation");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_lagcomp_interp", "100", "ms the clients show the other ships behind the newest state they received");
+
+    auto now = std::chrono::system_clock::now();
+    this->startTime = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+    this->currentTime = this->startTime;
 
 	// setup server
     if (enet_initialize() != 0)
@@ -60,10 +106,23 @@ bool ServerApp::Open()
         return false;
     }
     atexit(enet_deinitialize);
+    Core::CVar* sv_network_thread = Core::CVarCreate(Core::CVarType::CVar_Int, "sv_network_thread", "1", "service the ENet host on its own thread");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_maxplayers", "32", "most clients connected at once, read when the server is created");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_channels", "3", "most ENet channels a client may open, events, state and bulk traffic each get their own");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_bandwidth_in", "0", "incoming bytes per second ENet throttles the clients to, 0 for unlimited");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_bandwidth_out", "0", "outgoing bytes per second ENet throttles the server to, 0 for unlimited");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "net_compression", "0", "0 sends datagrams as they are, 1 with ENet's range coder, 2 with the net_dictionary compressor, server and clients must match");
+    Core::CVarCreate(Core::CVarType::CVar_String, "net_dictionary", "net_dictionary.bin", "dictionary file for net_compression 2, trained with the server's dictionary command");
+    Core::CVarCreate(Core::CVarType::CVar_Int, "sv_client_bandwidth", "32000", "snapshot bytes per second each client gets, the most overdue ship states are sent first, 0 for unlimited");
 
 	// setup console commands
     this->console = new Game::Console("Server", 128, 128, 10);
-	this->console->SetCommand("server", [this](const std::string& arg)
+    this->console->SetPanel([this]()
+    {
+        if (this->server != nullptr)
+            this->server->stats.Draw();
+    });
+	this->console->SetCommand("server", [this, sv_network_thread](const std::string& arg)
 	{
         if (this->server != nullptr)
             return;
@@ -81,96 +140,178 @@ bool ServerApp::Open()
             this->OnClientDisconnect(client);
         };
 
+        size_t maxPlayers = (size_t)std::max(1, Core::CVarReadInt(Core::CVarGet("sv_maxplayers")));
+        size_t channels = (size_t)std::max(1, Core::CVarReadInt(Core::CVarGet("sv_channels")));
+        enet_uint32 bandwidthIn = (enet_uint32)std::max(0, Core::CVarReadInt(Core::CVarGet("sv_bandwidth_in")));
+        enet_uint32 bandwidthOut = (enet_uint32)std::max(0, Core::CVarReadInt(Core::CVarGet("sv_bandwidth_out")));
+        this->InitSpawnPoints(maxPlayers);
+
         this->server = new Game::Server();
-        if (!this->server->Init(argIP.c_str(), argPort, connected, disconnected))
+        this->server->stats.SetMessageTypes(Protocol::EnumNamesPacketType(), Protocol::PacketType_MAX + 1, PacketTypeOf);
+        if (!this->server->Init(argIP.c_str(), argPort, connected, disconnected, maxPlayers, channels, bandwidthIn, bandwidthOut))
         {
             delete this->server;
             this->server = nullptr;
         }
         else
         {
-            this->console->AddOutput("[INFO] server created");
+            this->console->AddOutput("[INFO] server created for " + std::to_string(maxPlayers) + " players");
+            Game::Compression compression = (Game::Compression)Core::CVarReadInt(Core::CVarGet("net_compression"));
+            if (!this->server->SetCompression(compression, Core::CVarReadString(Core::CVarGet("net_dictionary"))))
+                this->console->AddOutput("[WARNING] compression could not be enabled, sending uncompressed");
+            if (Core::CVarReadInt(sv_network_thread) > 0 && this->server->StartServiceThread())
+                this->console->AddOutput("[INFO] network thread started");
         }
 	});
+    this->console->SetCommand("replay", [this](const std::string& arg)
+    {
+        if (this->server != nullptr)
+            return;
+
+        // replay <file> [1], 1 keeps the recorded pace instead of running the ticks back to back
+        size_t split = arg.find(' ');
+        std::string path = arg.substr(0, split);
+        bool realTime = split != std::string::npos && std::atoi(arg.c_str() + split + 1) > 0;
+        auto connected = [this](ENetPeer* client)
+        {
+            this->OnClientConnect(client);
+        };
+
+        auto disconnected = [this](ENetPeer* client)
+        {
+            this->OnClientDisconnect(client);
+        };
+
+        this->InitSpawnPoints((size_t)std::max(1, Core::CVarReadInt(Core::CVarGet("sv_maxplayers"))));
+        this->server = new Game::Server();
+        this->server->stats.SetMessageTypes(Protocol::EnumNamesPacketType(), Protocol::PacketType_MAX + 1, PacketTypeOf);
+        if (!this->server->InitReplay(path.c_str(), realTime, connected, disconnected))
+        {
+            delete this->server;
+            this->server = nullptr;
+            return;
+        }
+
+        this->replaying = true;
+        this->replayRealTime = realTime;
+        this->replayStartTick = this->tick;
+        this->replayStartTime = std::chrono::steady_clock::now();
+        this->console->AddOutput("[INFO] replaying " + path);
+    });
+    this->console->SetCommand("record", [this](const std::string& arg)
+    {
+        if (this->server == nullptr)
+            return;
+
+        // record <file> starts logging the traffic, record without a file stops
+        if (arg.empty())
+        {
+            this->server->StopRecording();
+            this->console->AddOutput("[INFO] recording stopped");
+        }
+        else if (this->server->StartRecording(arg.c_str()))
+        {
+            this->console->AddOutput("[INFO] recording to " + arg);
+        }
+    });
+    this->console->SetCommand("dictionary", [this](const std::string& arg)
+    {
+        // dictionary <log> [bytes], trains net_dictionary on the messages sent in a traffic log
+        size_t split = arg.find(' ');
+        std::string path = arg.substr(0, split);
+        size_t size = split != std::string::npos ? (size_t)std::max(0, std::atoi(arg.c_str() + split + 1)) : Game::NetDictionary::maxSize;
+        const char* output = Core::CVarReadString(Core::CVarGet("net_dictionary"));
+
+        Game::NetDictionary dictionary;
+        if (dictionary.Train(path.c_str(), size) && dictionary.Save(output))
+            this->console->AddOutput("[INFO] wrote " + std::to_string(dictionary.data.size()) + " byte dictionary to " + output);
+    });
+    this->console->SetCommand("compressbench", [this](const std::string& arg)
+    {
+        // compressbench <log>, compares the codecs on every message sent in a traffic log
+        Game::NetDictionary dictionary;
+        bool hasDictionary = dictionary.Load(Core::CVarReadString(Core::CVarGet("net_dictionary")));
+        Game::BenchmarkCompression(arg.c_str(), hasDictionary ? &dictionary : nullptr, Protocol::EnumNamesPacketType(), Protocol::PacketType_MAX + 1, PacketTypeOf);
+    });
     this->console->SetCommand("msg", [this](const std::string& arg)
     {
         if (this->server == nullptr)
             return;
 
-        flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
+        flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
         auto outPacket = Protocol::CreateTextS2CDirect(builder, arg.c_str());
-        auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_TextS2C, outPacket.Union());
-        builder.Finish(packetWrapper);
+        this->FinishPacket(builder, Protocol::PacketType_TextS2C, outPacket.Union());
 
-        this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ENET_PACKET_FLAG_RELIABLE);
+        this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ChannelFor(Protocol::PacketType_TextS2C));
         this->console->AddOutput("[MESSAGE] you: " + arg);
     });
+    this->console->SetCommand("set", [this](const std::string& arg)
+    {
+        size_t split = arg.find(' ');
+        Core::CVar* cvar = Core::CVarGet(arg.substr(0, split).c_str());
+        if (cvar == nullptr || split == std::string::npos)
+        {
+            this->console->AddOutput("[WARNING] usage: set <cvar> <value>");
+            return;
+        }
 
-	// setup space ships and lasers
-	this->InitSpawnPoints();
-    this->spaceShipModel = Render::LoadModel("assets/space/spaceship.glb");
+        Core::CVarParseWrite(cvar, arg.substr(split + 1).c_str());
+    });
+    this->console->SetCommand("pool", [this](const std::string& arg)
+    {
+        if (this->server == nullptr)
+            return;
+
+        const Game::PacketPool& pool = this->server->receivePool;
+        this->console->AddOutput("[INFO] receive pool hits: " + std::to_string(pool.hits) + " misses: " + std::to_string(pool.misses));
+    });
+
+	// setup space ships and lasers, the spawn points follow the capacity the server is created with
     this->spaceShipCollisionRadiusSquared = 2.f * 2.f;
-    this->laserModel = Render::LoadModel("assets/space/laser.glb");
     this->laserMaxTime = 3000;
     this->laserSpeed = 20.f;
 
-    // load all resources
-    Render::ModelId models[6] = {
-        Render::LoadModel("assets/space/Asteroid_1.glb"),
-        Render::LoadModel("assets/space/Asteroid_2.glb"),
-        Render::LoadModel("assets/space/Asteroid_3.glb"),
-        Render::LoadModel("assets/space/Asteroid_4.glb"),
-        Render::LoadModel("assets/space/Asteroid_5.glb"),
-        Render::LoadModel("assets/space/Asteroid_6.glb")
-    };
-    Physics::ColliderMeshId colliderMeshes[6] = {
-        Physics::LoadColliderMesh("assets/space/Asteroid_1_physics.glb"),
-        Physics::LoadColliderMesh("assets/space/Asteroid_2_physics.glb"),
-        Physics::LoadColliderMesh("assets/space/Asteroid_3_physics.glb"),
-        Physics::LoadColliderMesh("assets/space/Asteroid_4_physics.glb"),
-        Physics::LoadColliderMesh("assets/space/Asteroid_5_physics.glb"),
-        Physics::LoadColliderMesh("assets/space/Asteroid_6_physics.glb")
-    };
+    this->InitAsteroids();
+#ifndef HEADLESS
+    this->InitScene();
+#endif
 
-    // setup asteroids near
-    for (int i = 0; i < 100; i++)
-    {
-        std::tuple<Render::ModelId, Physics::ColliderId, glm::mat4> asteroid;
-        size_t resourceIndex = (size_t)(Core::FastRandom() % 6);
-        std::get<0>(asteroid) = models[resourceIndex];
-        float span = 20.0f;
-        glm::vec3 translation = glm::vec3(
-            Core::RandomFloatNTP() * span,
-            Core::RandomFloatNTP() * span,
-            Core::RandomFloatNTP() * span
-        );
-        glm::vec3 rotationAxis = normalize(translation);
-        float rotation = translation.x;
-        glm::mat4 transform = glm::rotate(rotation, rotationAxis) * glm::translate(translation);
-        std::get<1>(asteroid) = Physics::CreateCollider(colliderMeshes[resourceIndex], transform);
-        std::get<2>(asteroid) = transform;
-        asteroids.push_back(asteroid);
-    }
+	return true;
+}
 
-    // setup asteroids far
-    for (int i = 0; i < 50; i++)
-    {
-        std::tuple<Render::ModelId, Physics::ColliderId, glm::mat4> asteroid;
-        size_t resourceIndex = (size_t)(Core::FastRandom() % 6);
-        std::get<0>(asteroid) = models[resourceIndex];
-        float span = 80.0f;
-        glm::vec3 translation = glm::vec3(
-            Core::RandomFloatNTP() * span,
-            Core::RandomFloatNTP() * span,
-            Core::RandomFloatNTP() * span
-        );
-        glm::vec3 rotationAxis = normalize(translation);
-        float rotation = translation.x;
-        glm::mat4 transform = glm::rotate(rotation, rotationAxis) * glm::translate(translation);
-        std::get<1>(asteroid) = Physics::CreateCollider(colliderMeshes[resourceIndex], transform);
-        std::get<2>(asteroid) = transform;
-        asteroids.push_back(asteroid);
-    }
+#ifndef HEADLESS
+bool ServerApp::OpenWindow()
+{
+    int width = 1280; 
+    int height = 720;
+
+	// setup window and rendering
+	this->window = new Display::Window;
+	this->window->SetSize(width, height);
+
+	if (!this->window->Open())
+		return false;
+
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	Render::RenderDevice::Init();
+
+	this->window->SetUiRender([this]()
+	{
+		this->RenderUI();
+	});
+
+    // setup main camera
+    Render::Camera* cam = Render::CameraManager::GetCamera(CAMERA_MAIN);
+    cam->projection = glm::perspective(glm::radians(90.0f), float(width) / float(height), 0.01f, 1000.f);
+    cam->view = glm::lookAt(glm::vec3(0.f, 0.f, -100.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+
+    return true;
+}
+
+void ServerApp::InitScene()
+{
+    this->spaceShipModel = Render::LoadModel("assets/space/spaceship.glb");
+    this->laserModel = Render::LoadModel("assets/space/laser.glb");
 
     // setup skybox
     std::vector<const char*> skybox
@@ -201,24 +342,24 @@ bool ServerApp::Open()
         );
         Render::LightServer::CreatePointLight(translation, color, Core::RandomFloat() * 4.0f, 1.0f + (15 + Core::RandomFloat() * 10.0f));
     }
-
-	return true;
 }
+#endif
 
 void ServerApp::Run()
 {
-    Input::Keyboard* kbd = Input::GetDefaultKeyboard();
+    double accumulator = 0.0;
+    auto previous = std::chrono::steady_clock::now();
 
-    std::clock_t c_start = std::clock();
-    double dt = 0.01667f;
+#ifndef HEADLESS
+    Input::Keyboard* kbd = Input::GetDefaultKeyboard();
 
-    // game loop
+    // game loop, the simulation runs at the tick rate and rendering at whatever the window manages
     while (this->window->IsOpen())
     {
         auto timeStart = std::chrono::steady_clock::now();
-        auto now = std::chrono::system_clock::now();
-        auto duration = now.time_since_epoch();
-        this->currentTime = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+        double dt = std::chrono::duration<double>(timeStart - previous).count();
+        previous = timeStart;
+        accumulator += dt;
 
         glClear(GL_DEPTH_BUFFER_BIT);
         glEnable(GL_DEPTH_TEST);
@@ -227,9 +368,7 @@ void ServerApp::Run()
 
         this->window->Update();
 
-        this->UpdateLasers();
-        this->UpdateSpaceShips(dt);
-        this->UpdateNetwork();
+        this->RunTicks(accumulator);
 
         if (kbd->pressed[Input::Key::Code::End])
         {
@@ -238,26 +377,110 @@ void ServerApp::Run()
        
         Render::Camera* cam = Render::CameraManager::GetCamera(CAMERA_MAIN);
         cam->view = glm::lookAt(glm::vec3(0.f, 0.f, -100.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
-        
 
         // Store all drawcalls in the render device
-        for (auto const& asteroid : this->asteroids)
-        {
-            Render::RenderDevice::Draw(std::get<0>(asteroid), std::get<2>(asteroid));
-        }
+        this->Draw();
 
         // Execute the entire rendering pipeline
-        Render::RenderDevice::Render(this->window, dt);
+        Render::RenderDevice::Render(this->window, (float)std::min(0.04, dt));
 
         // transfer new frame to window
         this->window->SwapBuffers();
 
-        auto timeEnd = std::chrono::steady_clock::now();
-        dt = std::min(0.04, std::chrono::duration<double>(timeEnd - timeStart).count());
-
         if (kbd->pressed[Input::Key::Code::Escape])
             break;
     }
+#else
+    Core::CVar* sv_tickrate = Core::CVarGet("sv_tickrate");
+
+    // simulation loop, run the ticks that are due and wait for the next one
+    while (!quitRequested)
+    {
+        auto now = std::chrono::steady_clock::now();
+        accumulator += std::chrono::duration<double>(now - previous).count();
+        previous = now;
+
+        double tickDeltaTime = 1.0 / (double)std::max(1, Core::CVarReadInt(sv_tickrate));
+        if (this->replaying && !this->replayRealTime)
+        {
+            // a replay as fast as possible runs the recorded ticks back to back
+            this->Tick((float)tickDeltaTime);
+            accumulator = 0.0;
+            continue;
+        }
+
+        this->RunTicks(accumulator);
+        this->WaitFor(tickDeltaTime - accumulator);
+    }
+#endif
+}
+
+void ServerApp::RunTicks(double& accumulator)
+{
+    Core::CVar* sv_tickrate = Core::CVarGet("sv_tickrate");
+    Core::CVar* sv_maxticks = Core::CVarGet("sv_maxticks");
+    double tickDeltaTime = 1.0 / (double)std::max(1, Core::CVarReadInt(sv_tickrate));
+    int maxTicks = std::max(1, Core::CVarReadInt(sv_maxticks));
+
+    int ticks = 0;
+    while (accumulator >= tickDeltaTime)
+    {
+        // too far behind to catch up, drop the backlog rather than spiral
+        if (ticks == maxTicks)
+        {
+            this->droppedTime += accumulator;
+            accumulator = 0.0;
+            break;
+        }
+
+        this->Tick((float)tickDeltaTime);
+        accumulator -= tickDeltaTime;
+        ticks++;
+    }
+}
+
+void ServerApp::Tick(float deltaTime)
+{
+    this->tick++;
+    this->simulationTime += deltaTime;
+    this->currentTime = this->startTime + (uint64)(this->simulationTime * 1000.0);
+
+    this->UpdateLasers(deltaTime);
+    this->UpdateSpaceShips(deltaTime);
+    this->UpdateNetwork();
+
+    // everything built this tick has been copied into the send queues
+    this->messages.Reset();
+
+    if (this->replaying && !this->server->IsReplaying())
+        this->EndReplay();
+}
+
+#ifdef HEADLESS
+void ServerApp::WaitFor(double seconds)
+{
+    if (seconds <= 0.0)
+        return;
+
+    // sleeping overshoots by up to the scheduler granularity, spin through the last part
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    auto spin = std::chrono::milliseconds(std::max(0, Core::CVarReadInt(Core::CVarGet("sv_spinwait"))));
+    std::this_thread::sleep_until(deadline - spin);
+    while (std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+}
+#endif
+
+void ServerApp::EndReplay()
+{
+    this->replaying = false;
+    uint32 ticks = this->tick - this->replayStartTick;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->replayStartTime).count();
+    printf("\n[INFO] replayed %u ticks in %.3f s, %.1f ticks per second.\n", ticks, seconds, (double)ticks / std::max(seconds, 1e-9));
+#ifdef HEADLESS
+    // the replay was the benchmark, there is nothing left to serve
+    quitRequested = 1;
+#endif
 }
 
 void ServerApp::Exit()
@@ -268,37 +491,101 @@ void ServerApp::Exit()
     for (size_t i = 0; i < this->lasers.size(); i++)
         delete this->lasers[i];
 
+#ifndef HEADLESS
     this->window->Close();
     delete this->window;
+#endif
     delete this->console;
     delete this->server;
 }
 
+void ServerApp::Execute(const std::string& command)
+{
+    this->console->Execute(command);
+}
+
 void ServerApp::OnClientConnect(ENetPeer* client)
 {
     this->console->AddOutput("[INFO] client connected");
+    this->clients[client] = ClientData();
     this->SpawnSpaceShip(client);
-    this->SendGameState(client);
     this->SendClientConnect(client);
+    // the game state follows in chunks from the next replication on
 }
 
 void ServerApp::OnClientDisconnect(ENetPeer* client)
 {
     this->console->AddOutput("[INFO] client disconnected");
+    this->clients.erase(client);
     this->DespawnSpaceShip(client);
 }
 
-void ServerApp::InitSpawnPoints()
+void ServerApp::InitSpawnPoints(size_t count)
 {
+    // rings of 32 around the asteroids, stacked alternately above and below the first
     float radius = 100.f;
-    for (int i = 0; i < 32; i++)
-    {
-        float angle = (float)i / 33.f * 3.1415f * 2.f;
-        spawnPoints.push_back(glm::vec3(
-            radius * glm::cos(angle),
-            0.f,
-            radius * glm::sin(angle)
-        ));
+    float ringSpacing = 12.f;
+    size_t rings = (std::max<size_t>(count, 32) + 31) / 32;
+
+    this->spawnPoints.clear();
+    for (size_t ring = 0; ring < rings; ring++)
+    {
+        float height = (float)((ring + 1) / 2) * ringSpacing * (ring % 2 == 1 ? 1.f : -1.f);
+        float offset = ring % 2 == 1 ? 0.5f : 0.f;
+        for (int i = 0; i < 32; i++)
+        {
+            float angle = ((float)i + offset) / 33.f * 3.1415f * 2.f;
+            this->spawnPoints.push_back(glm::vec3(
+                radius * glm::cos(angle),
+                height,
+                radius * glm::sin(angle)
+            ));
+        }
+    }
+}
+
+void ServerApp::InitAsteroids()
+{
+    // the colliders have to match the asteroids every client draws, so keep the random sequence the same
+#ifndef HEADLESS
+    Render::ModelId models[6] = {
+        Render::LoadModel("assets/space/Asteroid_1.glb"),
+        Render::LoadModel("assets/space/Asteroid_2.glb"),
+        Render::LoadModel("assets/space/Asteroid_3.glb"),
+        Render::LoadModel("assets/space/Asteroid_4.glb"),
+        Render::LoadModel("assets/space/Asteroid_5.glb"),
+        Render::LoadModel("assets/space/Asteroid_6.glb")
+    };
+#endif
+    Physics::ColliderMeshId colliderMeshes[6] = {
+        Physics::LoadColliderMesh("assets/space/Asteroid_1_physics.glb"),
+        Physics::LoadColliderMesh("assets/space/Asteroid_2_physics.glb"),
+        Physics::LoadColliderMesh("assets/space/Asteroid_3_physics.glb"),
+        Physics::LoadColliderMesh("assets/space/Asteroid_4_physics.glb"),
+        Physics::LoadColliderMesh("assets/space/Asteroid_5_physics.glb"),
+        Physics::LoadColliderMesh("assets/space/Asteroid_6_physics.glb")
+    };
+
+    // 100 asteroids near and 50 far
+    const std::pair<int, float> fields[2] = { { 100, 20.0f }, { 50, 80.0f } };
+    for (auto const& [count, span] : fields)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            size_t resourceIndex = (size_t)(Core::FastRandom() % 6);
+            glm::vec3 translation = glm::vec3(
+                Core::RandomFloatNTP() * span,
+                Core::RandomFloatNTP() * span,
+                Core::RandomFloatNTP() * span
+            );
+            glm::vec3 rotationAxis = normalize(translation);
+            float rotation = translation.x;
+            glm::mat4 transform = glm::rotate(rotation, rotationAxis) * glm::translate(translation);
+            Physics::ColliderId collider = Physics::CreateCollider(colliderMeshes[resourceIndex], transform);
+#ifndef HEADLESS
+            this->asteroids.push_back(std::make_tuple(models[resourceIndex], collider, transform));
+#endif
+        }
     }
 }
 
@@ -307,13 +594,29 @@ void ServerApp::InitSpawnPoints()
 
 void ServerApp::RenderUI()
 {
+#ifndef HEADLESS
     if (this->window->IsOpen())
     {
         this->console->Draw();
         Debug::DispatchDebugTextDrawing();
     }
+#endif
 }
 
+#ifndef HEADLESS
+void ServerApp::Draw()
+{
+    for (auto const& asteroid : this->asteroids)
+        Render::RenderDevice::Draw(std::get<0>(asteroid), std::get<2>(asteroid));
+
+    for (auto& spaceShip : this->spaceShips)
+        Render::RenderDevice::Draw(this->spaceShipModel, spaceShip.second->transform);
+
+    for (auto& laser : this->lasers)
+        Render::RenderDevice::Draw(this->laserModel, laser->GetLocalToWorld(this->currentTime, this->laserSpeed));
+}
+#endif
+
 void ServerApp::UpdateNetwork()
 {
     if (this->server == nullptr)
@@ -324,7 +627,7 @@ void ServerApp::UpdateNetwork()
     Game::PeerData data;
     while (this->server->PopDataStack(data))
     {
-        auto packet = Protocol::GetPacketWrapper(&data.data->front());
+        auto packet = Protocol::GetPacketWrapper(data.data);
         Protocol::PacketType packetType = packet->packet_type();
         switch (packetType)
         {
@@ -334,8 +637,15 @@ void ServerApp::UpdateNetwork()
         case Protocol::PacketType::PacketType_TextC2S:
             this->HandleMsgText(data.sender, packet);
             break;
+        case Protocol::PacketType::PacketType_ClockSyncC2S:
+            this->HandleMsgClockSync(data.sender, packet);
+            break;
         }
     }
+
+    // send everything queued during this tick in one go
+    this->server->Flush();
+    this->server->stats.Report(this->currentTime);
 }
 
 void ServerApp::UpdateSpaceShips(float deltaTime)
@@ -349,7 +659,7 @@ void ServerApp::UpdateSpaceShips(float deltaTime)
         {
             spaceShip.second->timeSinceLastLaser = 0.f;
             this->SpawnLaser(spaceShip.second->position, spaceShip.second->direction,
-                spaceShip.second->id, this->currentTime);
+                spaceShip.second->id, this->currentTime, this->LagCompensation(spaceShip.first));
         }
 
         // check asteroid collisions and previously detected hits
@@ -381,13 +691,15 @@ void ServerApp::UpdateSpaceShips(float deltaTime)
         
 
         spaceShip.second->ServerUpdate(deltaTime);
-        this->UpdateSpaceShipData(spaceShip.first);
-
-        Render::RenderDevice::Draw(this->spaceShipModel, spaceShip.second->transform);
     }
+
+    for (auto& spaceShip : this->spaceShips)
+        this->clients[spaceShip.first].positions.Record(this->tick, spaceShip.second->position);
+
+    this->UpdateReplication(deltaTime);
 }
 
-void ServerApp::UpdateLasers()
+void ServerApp::UpdateLasers(float deltaTime)
 {
     // iterate over lasers in reverse order
     for (int i = static_cast<int>(this->lasers.size()) - 1; i >= 0; i--)
@@ -399,18 +711,24 @@ void ServerApp::UpdateLasers()
             continue;
         }
 
-        // check space ship collision
+        // check space ship collision, against the ships as far in the past as the shooter saw them
         bool hitShip = false;
         glm::vec3 currentPos = this->lasers[i]->GetPosition(this->currentTime, this->laserSpeed);
+        float rewindTick = (float)this->tick - (float)this->lasers[i]->rewind * 0.001f / deltaTime;
         for (auto& spaceShip : this->spaceShips)
         {
             if (spaceShip.second->id == this->lasers[i]->spaceShipId)// ignore the ship it was fired from
                 continue;
 
-            glm::vec3 diff = currentPos - spaceShip.second->position;
+            glm::vec3 shipPos = spaceShip.second->position;
+            if (this->lasers[i]->rewind > 0)
+                this->clients[spaceShip.first].positions.Sample(rewindTick, shipPos);
+
+            glm::vec3 diff = currentPos - shipPos;
             if (glm::dot(diff, diff) < this->spaceShipCollisionRadiusSquared)
             {
                 spaceShip.second->isHit = true;
+                this->DespawnLaser(i, spaceShip.second);
                 hitShip = true;
                 break;
             }
@@ -429,12 +747,29 @@ void ServerApp::UpdateLasers()
             this->DespawnLaser(i);
             continue;
         }
-
-        // draw
-        Render::RenderDevice::Draw(this->laserModel, this->lasers[i]->GetLocalToWorld(currentTime, this->laserSpeed));
     }
 }
 
+uint32 ServerApp::LagCompensation(ENetPeer* shooter)
+{
+    Core::CVar* sv_lagcomp_max = Core::CVarGet("sv_lagcomp_max");
+    Core::CVar* sv_lagcomp_interp = Core::CVarGet("sv_lagcomp_interp");
+    int maxRewind = Core::CVarReadInt(sv_lagcomp_max);
+    if (maxRewind <= 0)
+        return 0;
+
+    // the input that fired took half a round trip to get here and waited since, the shooter's view
+    // of the other ships was another interpolation delay behind the newest state it had
+    uint32 roundTripTime = 0;
+    auto peerStats = this->server->stats.peers.find(shooter);
+    if (peerStats != this->server->stats.peers.end())
+        roundTripTime = peerStats->second.roundTripTime;
+
+    uint64 waited = this->currentTime - std::min(this->currentTime, this->clients[shooter].inputArrival);
+    uint64 rewind = waited + roundTripTime / 2 + (uint64)std::max(0, Core::CVarReadInt(sv_lagcomp_interp));
+    return (uint32)std::min<uint64>(rewind, (uint64)maxRewind);
+}
+
 //unpack messages from client
 
 void ServerApp::PackPlayer(Game::SpaceShip* spaceShip, Protocol::Player& p_player)
@@ -453,6 +788,24 @@ void ServerApp::PackLaser(Game::Laser* laser, Protocol::Laser& p_laser)
     p_laser = Protocol::Laser(laser->id, laser->startTime, laser->endTime, p_origin, p_orientation);
 }
 
+void ServerApp::PackPlayerState(Game::SpaceShip* spaceShip, Protocol::PlayerState& p_state)
+{
+    uint16 x, y, z;
+    Game::QuantizePosition(spaceShip->position, x, y, z);
+    uint32 velocity = Game::QuantizeVelocity(spaceShip->linearVelocity, Game::SpaceShip::boostSpeed);
+    uint32 orientation = Game::QuantizeOrientation(spaceShip->direction);
+    p_state = Protocol::PlayerState((uint16)spaceShip->id, x, y, z, velocity, orientation);
+}
+
+void ServerApp::PackLaserState(Game::Laser* laser, Protocol::LaserState& p_state)
+{
+    uint16 x, y, z;
+    Game::QuantizePosition(laser->origin, x, y, z);
+    uint32 orientation = Game::QuantizeOrientation(laser->direction);
+    uint16 lifetime = (uint16)glm::min<uint64>(laser->endTime - laser->startTime, 0xFFFF);
+    p_state = Protocol::LaserState(laser->startTime, laser->id, orientation, x, y, z, lifetime);
+}
+
 void ServerApp::HandleMsgInput(ENetPeer* sender, const Protocol::PacketWrapper* packet)
 {
     if (this->spaceShips.count(sender) == 0)
@@ -475,7 +828,15 @@ void ServerApp::HandleMsgInput(ENetPeer* sender, const Protocol::PacketWrapper*
     data.shift = inputData & 256;
     data.timeStamp = inPacket->time();
 
+    ClientData& clientData = this->clients[sender];
+    if (data.timeStamp > this->spaceShips[sender]->inputData.timeStamp)
+        clientData.inputArrival = this->currentTime;
     this->spaceShips[sender]->SetInputData(data);
+
+    // inputs are unreliable and may arrive out of order, only move the acknowledgement forward
+    uint32 ack = inPacket->snapshot_ack();
+    if (ack > clientData.ackedSequence && ack < clientData.nextSequence)
+        clientData.ackedSequence = ack;
 }
 
 void ServerApp::HandleMsgText(ENetPeer* sender, const Protocol::PacketWrapper* packet)
@@ -488,48 +849,53 @@ void ServerApp::HandleMsgText(ENetPeer* sender, const Protocol::PacketWrapper* p
     this->console->AddOutput(msg);
 
     // send text to all others
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
     auto outPacket = Protocol::CreateTextS2CDirect(builder, inPacket->text()->c_str());
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_TextS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ENET_PACKET_FLAG_RELIABLE, sender);
+    this->FinishPacket(builder, Protocol::PacketType_TextS2C, outPacket.Union());
+    this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ChannelFor(Protocol::PacketType_TextS2C), sender);
+}
+
+void ServerApp::HandleMsgClockSync(ENetPeer* sender, const Protocol::PacketWrapper* packet)
+{
+    // answered on the tick it arrives with the time every other message of the tick carries
+    const Protocol::ClockSyncC2S* inPacket = static_cast<const Protocol::ClockSyncC2S*>(packet->packet());
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+    auto outPacket = Protocol::CreateClockSyncS2C(builder, inPacket->client_time(), this->currentTime);
+    this->FinishPacket(builder, Protocol::PacketType_ClockSyncS2C, outPacket.Union());
+    this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), sender, ChannelFor(Protocol::PacketType_ClockSyncS2C));
 }
 
 
 //methods that send data to the clients 
 
+void ServerApp::FinishPacket(flatbuffers::FlatBufferBuilder& builder, Protocol::PacketType type, flatbuffers::Offset<void> packet)
+{
+    auto packetWrapper = Protocol::CreatePacketWrapper(builder, type, packet, this->tick);
+    builder.Finish(packetWrapper);
+}
+
 void ServerApp::SpawnSpaceShip(ENetPeer* client)
 {
     static size_t spawnIndex = 0;
+
+    // the compact state encoding only carries 16 bits of the id, skip ids still in use once they wrap
+    uint32 id;
+    bool idInUse;
+    do
+    {
+        id = this->nextSpaceShipId++ & 0xFFFF;
+        idInUse = false;
+        for (auto& spaceShip : this->spaceShips)
+            idInUse |= spaceShip.second->id == id;
+    } while (idInUse);
+
     Game::SpaceShip* spaceShip = new Game::SpaceShip();
-    spaceShip->id = this->nextSpaceShipId;
-    spaceShip->position = this->spawnPoints[spawnIndex++ % 32];
+    spaceShip->id = id;
+    spaceShip->position = this->spawnPoints[spawnIndex++ % this->spawnPoints.size()];
     spaceShip->direction = glm::quatLookAt(glm::normalize(spaceShip->position), glm::vec3(0.f, 1.f, 0.f));
     this->spaceShips[client] = spaceShip;
-    this->nextSpaceShipId++;
 
-    // send messages to others
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
-    Protocol::Player p_player;
-    this->PackPlayer(spaceShip, p_player);
-    auto outPacket = Protocol::CreateSpawnPlayerS2C(builder, &p_player);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_SpawnPlayerS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ENET_PACKET_FLAG_RELIABLE, client);
-}
-
-void ServerApp::UpdateSpaceShipData(ENetPeer* client)
-{
-    Game::SpaceShip* spaceShip = spaceShips[client];
-
-    // send messages to others
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
-    Protocol::Player p_player;
-    this->PackPlayer(spaceShip, p_player);
-    auto outPacket = Protocol::CreateUpdatePlayerS2C(builder, this->currentTime, &p_player);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_UpdatePlayerS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+    // other clients get the spawn message once the ship becomes relevant to them
 }
 
 void ServerApp::DespawnSpaceShip(ENetPeer* client)
@@ -538,12 +904,12 @@ void ServerApp::DespawnSpaceShip(ENetPeer* client)
     delete this->spaceShips[client];
     this->spaceShips.erase(client);
 
-    // send message to others
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
-    auto outPacket = Protocol::CreateDespawnPlayerS2C(builder, id);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_DespawnPlayerS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ENET_PACKET_FLAG_RELIABLE, client);
+    // send message to the clients that know about the ship
+    for (auto& [peer, clientData] : this->clients)
+    {
+        if (clientData.knownShips.erase(id) > 0)
+            this->SendDespawnPlayer(peer, id);
+    }
 }
 
 void ServerApp::RespawnSpaceShip(ENetPeer* client)
@@ -557,82 +923,414 @@ void ServerApp::RespawnSpaceShip(ENetPeer* client)
     //and assigns the result back to spawnIndex
 
     Game::SpaceShip* spaceShip = this->spaceShips[client];
-    spaceShip->position = this->spawnPoints[spawnIndex % 32];
+    spaceShip->position = this->spawnPoints[spawnIndex % this->spawnPoints.size()];
     spaceShip->linearVelocity = glm::vec3(0.f);
     spaceShip->direction = glm::quatLookAt(glm::normalize(spaceShip->position), glm::vec3(0.f, 1.f, 0.f));
     spaceShip->isHit = false;
     this->nextSpaceShipId++;
 
-    // send message to others
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
+    // lasers fired before the teleport must not hit the old position
+    this->clients[client].positions.Clear();
+
+    // send message to the clients that know about the ship
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
     Protocol::Player p_player;
     this->PackPlayer(spaceShip, p_player);
     auto outPacket = Protocol::CreateTeleportPlayerS2C(builder, this->currentTime, &p_player);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_TeleportPlayerS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ENET_PACKET_FLAG_RELIABLE);
+    this->FinishPacket(builder, Protocol::PacketType_TeleportPlayerS2C, outPacket.Union());
+    for (auto& [peer, clientData] : this->clients)
+    {
+        if (clientData.knownShips.count(spaceShip->id) > 0)
+            this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), peer, ChannelFor(Protocol::PacketType_TeleportPlayerS2C));
+    }
+}
+
+void ServerApp::SendClientConnect(ENetPeer* client)
+{
+    uint32 id = spaceShips[client]->id;
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+    auto outPacket = Protocol::CreateClientConnectS2C(builder, id, this->currentTime);
+    this->FinishPacket(builder, Protocol::PacketType_ClientConnectS2C, outPacket.Union());
+    this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), client, ChannelFor(Protocol::PacketType_ClientConnectS2C));
 }
 
-void ServerApp::SendGameState(ENetPeer* client)
+void ServerApp::SpawnLaser(const glm::vec3& origin, const glm::quat& direction, uint32 spaceShipId, uint64 currentTimeMillis, uint32 rewind)
 {
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
-    
-    std::vector<Protocol::Player> p_players;
+    Game::Laser* laser = new Game::Laser(this->nextLaserId, currentTimeMillis, currentTimeMillis + this->laserMaxTime, origin, direction, spaceShipId);
+    laser->rewind = rewind;
+    this->lasers.Insert(laser->id, laser);
+    this->nextLaserId++;
+
+    // clients get the spawn message once the laser becomes relevant to them
+}
+
+void ServerApp::DespawnLaser(size_t index, Game::SpaceShip* hitShip)
+{
+    uint32 id = this->lasers[index]->id;
+    delete this->lasers[index];
+    this->lasers.EraseAt(index);
+
+    for (auto& [peer, clientData] : this->clients)
+    {
+        if (clientData.knownLasers.erase(id) == 0)
+            continue;
+
+        if (hitShip != nullptr)
+            clientData.laserHits.push_back({ id, hitShip->id });
+        else
+            clientData.despawnedLasers.push_back(id);
+    }
+}
+
+
+//replication
+
+void ServerApp::UpdateReplication(float deltaTime)
+{
+    if (this->server == nullptr)
+        return;
+
+    // the full states the join chunks are cut from are only needed while someone is joining
+    bool joining = false;
+    for (auto& [peer, clientData] : this->clients)
+        joining |= clientData.joining;
+
+    // rebuild the interest grids, ships are packed once and shared by all clients
+    this->shipGrid.Clear();
+    this->gridShips.clear();
+    this->gridPlayers.clear();
+    this->joinPlayers.clear();
     for (auto& spaceShip : this->spaceShips)
     {
-        Protocol::Player p_player;
-        this->PackPlayer(spaceShip.second, p_player);
-        p_players.push_back(p_player);
+        Protocol::PlayerState p_state;
+        this->PackPlayerState(spaceShip.second, p_state);
+        this->shipGrid.Insert((uint32)this->gridShips.size(), spaceShip.second->position);
+        this->gridShips.push_back(spaceShip.second);
+        this->gridPlayers.push_back(p_state);
+        if (joining)
+        {
+            Protocol::Player p_player;
+            this->PackPlayer(spaceShip.second, p_player);
+            this->joinPlayers.push_back(p_player);
+        }
     }
 
-    std::vector<Protocol::Laser> p_lasers;
-    for (auto& laser : this->lasers)
+    this->laserGrid.Clear();
+    this->joinLasers.clear();
+    for (size_t i = 0; i < this->lasers.size(); i++)
     {
-        Protocol::Laser p_laser;
-        this->PackLaser(laser, p_laser);
-        p_lasers.push_back(p_laser);
+        this->laserGrid.Insert((uint32)i, this->lasers[i]->GetPosition(this->currentTime, this->laserSpeed));
+        if (joining)
+        {
+            Protocol::Laser p_laser;
+            this->PackLaser(this->lasers[i], p_laser);
+            this->joinLasers.push_back(p_laser);
+        }
     }
 
-    auto outPacket = Protocol::CreateGameStateS2CDirect(builder, &p_players, &p_lasers);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_GameStateS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), client, ENET_PACKET_FLAG_RELIABLE);
+    for (auto& spaceShip : this->spaceShips)
+    {
+        ClientData& clientData = this->clients[spaceShip.first];
+        this->UpdateInterest(spaceShip.first, clientData, spaceShip.second);
+        this->SendSnapshot(spaceShip.first, clientData, spaceShip.second, deltaTime);
+        this->SendLaserEvents(spaceShip.first, clientData);
+    }
 }
 
-void ServerApp::SendClientConnect(ENetPeer* client)
+// bytes of a GameStateS2C that are not entities: the wrapper, the tables and the vector lengths, with room for
+// the padding that aligns each vector's elements
+static size_t GameStateFraming()
 {
-    uint32 id = spaceShips[client]->id;
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
-    auto outPacket = Protocol::CreateClientConnectS2C(builder, id, this->currentTime);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_ClientConnectS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), client, ENET_PACKET_FLAG_RELIABLE);
+    flatbuffers::FlatBufferBuilder builder;
+    std::vector<Protocol::Player> players;
+    std::vector<Protocol::Laser> lasers;
+    auto outPacket = Protocol::CreateGameStateS2CDirect(builder, &players, &lasers, UINT16_MAX, true);
+    builder.Finish(Protocol::CreatePacketWrapper(builder, Protocol::PacketType_GameStateS2C, outPacket.Union(), UINT32_MAX));
+    return builder.GetSize() + alignof(Protocol::Player) + alignof(Protocol::Laser);
 }
 
-void ServerApp::SpawnLaser(const glm::vec3& origin, const glm::quat& direction, uint32 spaceShipId, uint64 currentTimeMillis)
+void ServerApp::UpdateInterest(ENetPeer* client, ClientData& clientData, Game::SpaceShip* viewer)
 {
-    Game::Laser* laser = new Game::Laser(this->nextLaserId, currentTimeMillis, currentTimeMillis + this->laserMaxTime, origin, direction, spaceShipId);
-    this->lasers.push_back(laser);
-    this->nextLaserId++;
+    // a joining client gets the entities around it in chunks that each fit in a single datagram, instead of one
+    // spawn message each. whatever does not fit is left unknown and picked up again on the next tick, with its
+    // state of then
+    static const size_t gameStateFraming = GameStateFraming();
+    size_t joinBudget = SIZE_MAX;
+    bool joinComplete = true;
+    if (clientData.joining)
+    {
+        size_t datagram = this->server->MessageBudget(client);
+        joinBudget = datagram > gameStateFraming ? datagram - gameStateFraming : 0;
+        this->chunkPlayers.clear();
+        this->chunkLasers.clear();
+    }
 
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
-    Protocol::Laser p_laser;
-    this->PackLaser(laser, p_laser);
-    auto outPacket = Protocol::CreateSpawnLaserS2C(builder, &p_laser);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_SpawnLaserS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+    // ships entering and leaving relevance, the result is reused for the client's snapshot
+    this->relevantShips.clear();
+    this->shipGrid.Query(viewer->position, this->interestRadius, this->relevantShips);
+    this->relevantIds.clear();
+    size_t relevantCount = 0;
+    for (uint32 index : this->relevantShips)
+    {
+        Game::SpaceShip* spaceShip = this->gridShips[index];
+        if (clientData.knownShips.count(spaceShip->id) == 0)
+        {
+            if (!clientData.joining)
+            {
+                this->SendSpawnPlayer(client, spaceShip);
+            }
+            else if (joinBudget >= sizeof(Protocol::Player) || spaceShip == viewer)
+            {
+                // the client's own ship is always in the first chunk, the client starts simulating with it
+                this->chunkPlayers.push_back(this->joinPlayers[index]);
+                joinBudget -= std::min(joinBudget, sizeof(Protocol::Player));
+            }
+            else
+            {
+                joinComplete = false;
+                continue;
+            }
+            clientData.knownShips.insert(spaceShip->id);
+        }
+        this->relevantIds.push_back(spaceShip->id);
+        this->relevantShips[relevantCount++] = index;
+    }
+    this->relevantShips.resize(relevantCount);
+
+    std::sort(this->relevantIds.begin(), this->relevantIds.end());
+    for (auto it = clientData.knownShips.begin(); it != clientData.knownShips.end();)
+    {
+        if (!std::binary_search(this->relevantIds.begin(), this->relevantIds.end(), *it))
+        {
+            this->SendDespawnPlayer(client, *it);
+            clientData.priorities.erase(*it);
+            it = clientData.knownShips.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    // lasers entering and leaving relevance
+    this->interestQuery.clear();
+    this->laserGrid.Query(viewer->position, this->interestRadius, this->interestQuery);
+    this->relevantIds.clear();
+    for (uint32 index : this->interestQuery)
+    {
+        Game::Laser* laser = this->lasers[index];
+        if (clientData.knownLasers.count(laser->id) == 0)
+        {
+            if (!clientData.joining)
+            {
+                Protocol::LaserState p_state;
+                this->PackLaserState(laser, p_state);
+                clientData.spawnedLasers.push_back(p_state);
+            }
+            else if (joinBudget >= sizeof(Protocol::Laser))
+            {
+                this->chunkLasers.push_back(this->joinLasers[index]);
+                joinBudget -= sizeof(Protocol::Laser);
+            }
+            else
+            {
+                joinComplete = false;
+                continue;
+            }
+            clientData.knownLasers.insert(laser->id);
+        }
+        this->relevantIds.push_back(laser->id);
+    }
+
+    std::sort(this->relevantIds.begin(), this->relevantIds.end());
+    for (auto it = clientData.knownLasers.begin(); it != clientData.knownLasers.end();)
+    {
+        if (!std::binary_search(this->relevantIds.begin(), this->relevantIds.end(), *it))
+        {
+            clientData.despawnedLasers.push_back(*it);
+            it = clientData.knownLasers.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (clientData.joining)
+        this->SendGameState(client, clientData, joinComplete);
 }
 
-void ServerApp::DespawnLaser(size_t index)
+void ServerApp::SendSnapshot(ENetPeer* client, ClientData& clientData, Game::SpaceShip* viewer, float deltaTime)
 {
-    uint32 id = this->lasers[index]->id;
-    delete this->lasers[index];
-    this->lasers.erase(this->lasers.begin() + index);
-    
-    flatbuffers::FlatBufferBuilder builder = flatbuffers::FlatBufferBuilder();
-    auto outPacket = Protocol::CreateDespawnLaserS2C(builder, id);
-    auto packetWrapper = Protocol::CreatePacketWrapper(builder, Protocol::PacketType_DespawnLaserS2C, outPacket.Union());
-    builder.Finish(packetWrapper);
-    this->server->Broadcast(builder.GetBufferPointer(), builder.GetSize(), ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+    auto stateLess = [](const Protocol::PlayerState& a, const Protocol::PlayerState& b)
+    {
+        return a.uuid() < b.uuid();
+    };
+
+    // every relevant ship's priority accumulates each tick, the most overdue states are sent until
+    // the client's budget for this tick is used up. the client's own ship always goes first.
+    // the snapshot is delta encoded against the last one the client acknowledged, or sent whole
+    static const std::vector<Protocol::PlayerState> emptySnapshot;
+    auto baseline = clientData.history.Find(clientData.ackedSequence);
+    const std::vector<Protocol::PlayerState>& baselineStates = baseline != nullptr ? baseline->states : emptySnapshot;
+    this->snapshotOrder.clear();
+    for (uint32 index : this->relevantShips)
+    {
+        Game::SpaceShip* spaceShip = this->gridShips[index];
+        float& priority = clientData.priorities[spaceShip->id];
+        priority += this->Priority(viewer, spaceShip) * deltaTime;
+        this->snapshotOrder.push_back({ spaceShip == viewer ? FLT_MAX : priority, index });
+    }
+    std::sort(this->snapshotOrder.begin(), this->snapshotOrder.end(), [](const std::pair<float, uint32>& a, const std::pair<float, uint32>& b)
+    {
+        return a.first > b.first;
+    });
+
+    int bandwidth = Core::CVarReadInt(Core::CVarGet("sv_client_bandwidth"));
+    float budget = bandwidth > 0 ? (float)bandwidth * deltaTime : FLT_MAX;
+
+    // the budget pays for what goes on the wire, the states that differ from the baseline. ships left over repeat
+    // their baseline state, which keeps them out of the delta. a ship the client has no state for yet is sent
+    // regardless of the budget
+    this->clientSnapshot.clear();
+    for (auto& [priority, index] : this->snapshotOrder)
+    {
+        const Protocol::PlayerState& current = this->gridPlayers[index];
+        const Protocol::PlayerState* acked = nullptr;
+        auto found = std::lower_bound(baselineStates.begin(), baselineStates.end(), current, stateLess);
+        if (found != baselineStates.end() && found->uuid() == current.uuid())
+            acked = &*found;
+
+        bool unchanged = acked != nullptr && std::memcmp(acked, &current, sizeof(current)) == 0;
+        if (acked != nullptr && !unchanged && budget < (float)sizeof(current))
+        {
+            this->clientSnapshot.push_back(*acked);
+            continue;
+        }
+
+        if (!unchanged)
+            budget -= (float)sizeof(current);
+        clientData.priorities[this->gridShips[index]->id] = 0.f;
+        this->clientSnapshot.push_back(current);
+    }
+    std::sort(this->clientSnapshot.begin(), this->clientSnapshot.end(), stateLess);
+
+    Game::DiffSnapshots(baselineStates, this->clientSnapshot, this->snapshotChanged, this->snapshotRemoved);
+    uint32 baselineSequence = baseline != nullptr ? baseline->sequence : 0;
+
+    // may overwrite the baseline's slot, it is not used past here
+    uint32 sequence = clientData.nextSequence++;
+    clientData.history.Store(sequence).states = this->clientSnapshot;
+
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+    // the client replays the inputs newer than the one its ship's state already includes
+    auto outPacket = Protocol::CreateSnapshotS2CDirect(builder, this->currentTime, sequence, baselineSequence,
+        &this->snapshotChanged, &this->snapshotRemoved, nullptr, viewer->inputData.timeStamp, (uint32)(this->droppedTime * 1000.0));
+    this->FinishPacket(builder, Protocol::PacketType_SnapshotS2C, outPacket.Union());
+    this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), client, ChannelFor(Protocol::PacketType_SnapshotS2C));
+}
+
+float ServerApp::Priority(const Game::SpaceShip* viewer, const Game::SpaceShip* spaceShip) const
+{
+    // nearby ships and ships moving fast relative to the viewer go stale quickest,
+    // ships at the edge of relevance still get a tenth so they are never starved
+    float dist = glm::distance(viewer->position, spaceShip->position);
+    float nearness = std::max(0.1f, 1.f - dist / this->interestRadius);
+    float relativeSpeed = glm::length(spaceShip->linearVelocity - viewer->linearVelocity) / Game::SpaceShip::boostSpeed;
+    return nearness * (1.f + relativeSpeed);
+}
+
+void ServerApp::SendGameState(ENetPeer* client, ClientData& clientData, bool last)
+{
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+    auto outPacket = Protocol::CreateGameStateS2CDirect(builder, &this->chunkPlayers, &this->chunkLasers, clientData.joinChunk++, last);
+    this->FinishPacket(builder, Protocol::PacketType_GameStateS2C, outPacket.Union());
+    // in a packet of its own, sharing the events run would make ENet fragment it
+    this->server->SendDataAlone(builder.GetBufferPointer(), builder.GetSize(), client);
+    clientData.joining = !last;
+}
+
+void ServerApp::SendSpawnPlayer(ENetPeer* client, Game::SpaceShip* spaceShip)
+{
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+    Protocol::Player p_player;
+    this->PackPlayer(spaceShip, p_player);
+    auto outPacket = Protocol::CreateSpawnPlayerS2C(builder, &p_player);
+    this->FinishPacket(builder, Protocol::PacketType_SpawnPlayerS2C, outPacket.Union());
+    this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), client, ChannelFor(Protocol::PacketType_SpawnPlayerS2C));
+}
+
+void ServerApp::SendDespawnPlayer(ENetPeer* client, uint32 spaceShipId)
+{
+    flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+    auto outPacket = Protocol::CreateDespawnPlayerS2C(builder, spaceShipId);
+    this->FinishPacket(builder, Protocol::PacketType_DespawnPlayerS2C, outPacket.Union());
+    this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), client, ChannelFor(Protocol::PacketType_DespawnPlayerS2C));
+}
+
+void ServerApp::SendLaserEvents(ENetPeer* client, ClientData& clientData)
+{
+    std::vector<Protocol::LaserState>& spawned = clientData.spawnedLasers;
+    std::vector<uint32>& despawned = clientData.despawnedLasers;
+    std::vector<std::pair<uint32, uint32>>& hits = clientData.laserHits;
+    if (spawned.empty() && despawned.empty() && hits.empty())
+        return;
+
+    // every list is sorted so a uuid can be sent as the difference to the one before it
+    std::sort(spawned.begin(), spawned.end(), [](const Protocol::LaserState& a, const Protocol::LaserState& b)
+    {
+        return a.uuid() < b.uuid();
+    });
+    std::sort(despawned.begin(), despawned.end());
+    std::sort(hits.begin(), hits.end());
+
+    // one batch per 65536 uuids, which unless a laser lives for minutes is the whole tick
+    size_t s = 0, d = 0, h = 0;
+    while (s < spawned.size() || d < despawned.size() || h < hits.size())
+    {
+        uint32 base = UINT32_MAX;
+        if (s < spawned.size())
+            base = std::min(base, spawned[s].uuid());
+        if (d < despawned.size())
+            base = std::min(base, despawned[d]);
+        if (h < hits.size())
+            base = std::min(base, hits[h].first);
+        uint64 last = (uint64)base + 0xFFFF;
+
+        this->laserSpawns.clear();
+        uint32 previous = base;
+        for (; s < spawned.size() && spawned[s].uuid() <= last; s++)
+        {
+            const Protocol::LaserState& state = spawned[s];
+            int64 start = glm::clamp<int64>((int64)state.start_time() - (int64)this->currentTime, INT16_MIN, INT16_MAX);
+            this->laserSpawns.push_back(Protocol::LaserSpawn(state.direction(), (uint16)(state.uuid() - previous), (int16)start,
+                state.lifetime(), state.origin_x(), state.origin_y(), state.origin_z()));
+            previous = state.uuid();
+        }
+
+        this->laserDespawns.clear();
+        previous = base;
+        for (; d < despawned.size() && despawned[d] <= last; d++)
+        {
+            this->laserDespawns.push_back((uint16)(despawned[d] - previous));
+            previous = despawned[d];
+        }
+
+        this->laserHitEvents.clear();
+        previous = base;
+        for (; h < hits.size() && hits[h].first <= last; h++)
+        {
+            this->laserHitEvents.push_back(Protocol::LaserHit((uint16)(hits[h].first - previous), (uint16)hits[h].second));
+            previous = hits[h].first;
+        }
+
+        flatbuffers::FlatBufferBuilder& builder = this->messages.Acquire();
+        auto outPacket = Protocol::CreateLaserEventsS2CDirect(builder, this->currentTime, base, &this->laserSpawns, &this->laserDespawns, &this->laserHitEvents);
+        this->FinishPacket(builder, Protocol::PacketType_LaserEventsS2C, outPacket.Union());
+        this->server->SendData(builder.GetBufferPointer(), builder.GetSize(), client, ChannelFor(Protocol::PacketType_LaserEventsS2C));
+    }
+
+    spawned.clear();
+    despawned.clear();
+    hits.clear();
 }
\ No newline at end of file
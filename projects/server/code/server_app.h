@@ -1,16 +1,26 @@
 #pragma once
 
 #include "core/app.h"
+#ifndef HEADLESS
 #include "render/window.h"
 #include "render/model.h"
+#endif
 #include "render/physics.h"
 #include "networking/console.h"
 #include "networking/network.h"
 #include "networking/spaceship.h"
 #include "networking/laser.h"
+#include "networking/snapshot.h"
+#include "networking/spatialgrid.h"
+#include "networking/quantize.h"
+#include "networking/messagearena.h"
+#include "networking/lagcomp.h"
+#include "networking/slotmap.h"
 #include <vector>
-#include "..\..\generated\flat\proto.h"
+#include "proto.h"
 #include <unordered_map>
+#include <unordered_set>
+#include <chrono>
 
 class ServerApp : public Core::App
 {
@@ -22,49 +32,147 @@ public:
 	void Run();
 	void Exit();
 
+	void Execute(const std::string& command);
 	void OnClientConnect(ENetPeer* client);
 	void OnClientDisconnect(ENetPeer* client);
 
 private:
-	void InitSpawnPoints();
+#ifndef HEADLESS
+	bool OpenWindow();
+	void InitScene();
+#endif
+	void InitSpawnPoints(size_t count);
+	void InitAsteroids();
+
+	// fixed rate simulation
+	void RunTicks(double& accumulator);
+	void Tick(float deltaTime);
+#ifdef HEADLESS
+	void WaitFor(double seconds);
+#endif
+	void EndReplay();
 
 	// update functions
 	void RenderUI();
+#ifndef HEADLESS
+	void Draw();
+#endif
 	void UpdateNetwork();
 	void UpdateSpaceShips(float deltaTime);
-	void UpdateLasers();
+	void UpdateLasers(float deltaTime);
 
 	// unpack messages from client
 	void PackPlayer(Game::SpaceShip* spaceShip, Protocol::Player& p_player);
 	void PackLaser(Game::Laser* laser, Protocol::Laser& p_laser);
+	void PackPlayerState(Game::SpaceShip* spaceShip, Protocol::PlayerState& p_state);
+	void PackLaserState(Game::Laser* laser, Protocol::LaserState& p_state);
 	void HandleMsgInput(ENetPeer* sender, const Protocol::PacketWrapper* packet);
 	void HandleMsgText(ENetPeer* sender, const Protocol::PacketWrapper* packet);
+	void HandleMsgClockSync(ENetPeer* sender, const Protocol::PacketWrapper* packet);
 
 	// methods that send data to the clients
+	void FinishPacket(flatbuffers::FlatBufferBuilder& builder, Protocol::PacketType type, flatbuffers::Offset<void> packet);
 	void SpawnSpaceShip(ENetPeer* client);
-	void UpdateSpaceShipData(ENetPeer* client);
 	void DespawnSpaceShip(ENetPeer* client);
 	void RespawnSpaceShip(ENetPeer* client);
-	void SendGameState(ENetPeer* client);
 	void SendClientConnect(ENetPeer* client);
-	void SpawnLaser(const glm::vec3& origin, const glm::quat& direction, uint32 spaceShipId, uint64 currentTimeMillis);
-	void DespawnLaser(size_t index);
+	void SpawnLaser(const glm::vec3& origin, const glm::quat& direction, uint32 spaceShipId, uint64 currentTimeMillis, uint32 rewind);
+	void DespawnLaser(size_t index, Game::SpaceShip* hitShip = nullptr);
+
+	// lag compensation
+	uint32 LagCompensation(ENetPeer* shooter);
 
+	// replication, every client only hears about the ships and lasers around its own ship
+	struct ClientData;
+	void UpdateReplication(float deltaTime);
+	void UpdateInterest(ENetPeer* client, ClientData& clientData, Game::SpaceShip* viewer);
+	void SendGameState(ENetPeer* client, ClientData& clientData, bool last);
+	void SendSnapshot(ENetPeer* client, ClientData& clientData, Game::SpaceShip* viewer, float deltaTime);
+	float Priority(const Game::SpaceShip* viewer, const Game::SpaceShip* spaceShip) const;
+	void SendSpawnPlayer(ENetPeer* client, Game::SpaceShip* spaceShip);
+	void SendDespawnPlayer(ENetPeer* client, uint32 spaceShipId);
+	void SendLaserEvents(ENetPeer* client, ClientData& clientData);
+
+#ifndef HEADLESS
 	Display::Window* window;
+#endif
 	Game::Console* console;
 	Game::Server* server;
+	Game::MessageArena messages;
 	uint64 currentTime;
 
+	// simulation clock, currentTime is derived from the ticks run so far instead of the wall clock
+	uint32 tick;
+	uint64 startTime;
+	double simulationTime;
+	double droppedTime;		// seconds of backlog RunTicks gave up on, currentTime trails the wall clock by this much
+
+	// traffic log replay, see the replay command
+	bool replaying;
+	bool replayRealTime;
+	uint32 replayStartTick;
+	std::chrono::steady_clock::time_point replayStartTime;
+
+#ifndef HEADLESS
 	std::vector<std::tuple<Render::ModelId, Physics::ColliderId, glm::mat4>> asteroids;
+	Render::ModelId spaceShipModel;
+	Render::ModelId laserModel;
+#endif
 
 	std::unordered_map<ENetPeer*, Game::SpaceShip*> spaceShips;
-	Render::ModelId spaceShipModel;
 	uint32 nextSpaceShipId;
 	std::vector<glm::vec3> spawnPoints;
 	float spaceShipCollisionRadiusSquared;
 
-	std::vector<Game::Laser*> lasers;
-	Render::ModelId laserModel;
+	// per client replication state
+	struct ClientData
+	{
+		// snapshots sent to the client, kept so the next one can be delta encoded against the acknowledged one
+		Game::SnapshotHistory<Protocol::PlayerState> history;
+		uint32 nextSequence = 1;
+		uint32 ackedSequence = 0;
+
+		// entities currently spawned on the client
+		std::unordered_set<uint32> knownShips;
+		std::unordered_set<uint32> knownLasers;
+		// while joining, entities enter relevance at most a GameStateS2C chunk per tick
+		bool joining = true;
+		uint16 joinChunk = 0;
+		// laser events of the current tick, sent together by SendLaserEvents
+		std::vector<Protocol::LaserState> spawnedLasers;
+		std::vector<uint32> despawnedLasers;
+		std::vector<std::pair<uint32, uint32>> laserHits;	// laser, ship
+		// how overdue each known ship's state is, grows every tick until the state is sent
+		std::unordered_map<uint32, float> priorities;
+
+		// where the client's ship was over the last ticks, lasers of laggy shooters test against it
+		Game::PositionHistory<> positions;
+		// server time the ship's current input arrived
+		uint64 inputArrival = 0;
+	};
+	std::unordered_map<ENetPeer*, ClientData> clients;
+
+	float interestRadius;
+	Game::SpatialGrid shipGrid;
+	Game::SpatialGrid laserGrid;
+	std::vector<Game::SpaceShip*> gridShips;
+	std::vector<Protocol::PlayerState> gridPlayers;
+	std::vector<Protocol::Player> joinPlayers;		// full states of the grid entities, packed when a client is joining
+	std::vector<Protocol::Laser> joinLasers;
+	std::vector<Protocol::Player> chunkPlayers;
+	std::vector<Protocol::Laser> chunkLasers;
+	std::vector<uint32> relevantShips;
+	std::vector<uint32> interestQuery;
+	std::vector<uint32> relevantIds;
+	std::vector<std::pair<float, uint32>> snapshotOrder;
+	std::vector<Protocol::PlayerState> clientSnapshot;
+	std::vector<Protocol::PlayerState> snapshotChanged;
+	std::vector<uint32> snapshotRemoved;
+	std::vector<Protocol::LaserSpawn> laserSpawns;
+	std::vector<uint16> laserDespawns;
+	std::vector<Protocol::LaserHit> laserHitEvents;
+
+	Game::SlotMap<Game::Laser*> lasers;
 	uint32 nextLaserId;
 	uint64 laserMaxTime;
 	float laserSpeed;